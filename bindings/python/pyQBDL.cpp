@@ -9,12 +9,23 @@
 #include "QBDL/loaders/MachO.hpp"
 #include "QBDL/loaders/ELF.hpp"
 #include "QBDL/loaders/PE.hpp"
+#include "QBDL/perf_map.hpp"
+#include "QBDL/profile.hpp"
+#include "QBDL/tracing.hpp"
 
 #include <pybind11/functional.h>
 #include <pybind11/operators.h>
+#include <pybind11/stl.h>
 
 #include <stdexcept>
 
+// Exports are exposed as a read-only view on the list held by the loader
+PYBIND11_MAKE_OPAQUE(std::vector<QBDL::ExportedSymbol>);
+// Names of import slots and stats are views on the loader's data: the lists
+// must keep the loader alive
+PYBIND11_MAKE_OPAQUE(std::vector<QBDL::ImportSlot>);
+PYBIND11_MAKE_OPAQUE(std::vector<QBDL::ImportStats>);
+
 using namespace pybind11::literals; // used for named arguments ("args"_a)
 
 namespace QBDL {
@@ -31,6 +42,14 @@ struct PyTargetMemory: public TargetMemory
       ptr, len);
   }
 
+  bool munmap(uint64_t ptr, size_t len) override {
+    PYBIND11_OVERRIDE(
+      bool,
+      TargetMemory,
+      munmap,
+      ptr, len);
+  }
+
   bool mprotect(uint64_t ptr, size_t len, int flags) override {
     PYBIND11_OVERRIDE_PURE(
       bool,
@@ -65,6 +84,24 @@ struct PyTargetMemory: public TargetMemory
   }
 };
 
+// Copy of an ImportView: its strings are only valid during the call
+struct PyImport {
+  std::string library;
+  std::string name;
+  uint16_t ordinal;
+  uint16_t hint;
+  bool by_ordinal;
+
+  PyImport(ImportView const& import):
+    library{import.library}, name{import.name}, ordinal{import.ordinal},
+    hint{import.hint}, by_ordinal{import.by_ordinal}
+  { }
+
+  ImportView view() const {
+    return {library, name, ordinal, hint, by_ordinal};
+  }
+};
+
 struct PyTargetSystem: public TargetSystem
 {
   PyTargetSystem(TargetMemory& mem):
@@ -94,6 +131,30 @@ struct PyTargetSystem: public TargetSystem
       base_address_hint,
       binary_base_address, virtual_size);
   }
+
+  uint64_t ifunc_resolve(Loader& loader, uint64_t resolver) override {
+    // Written by hand so that the loader is passed by pointer: the macros
+    // would also forward it to the C++ fallback, that takes a reference.
+    {
+      py::gil_scoped_acquire gil;
+      py::function override = py::get_override(this, "ifunc_resolve");
+      if (override) {
+        return override(&loader, resolver).cast<uint64_t>();
+      }
+    }
+    return TargetSystem::ifunc_resolve(loader, resolver);
+  }
+
+  uint64_t symlink_import(Loader& loader, ImportView const& import) override {
+    {
+      py::gil_scoped_acquire gil;
+      py::function override = py::get_override(this, "symlink_import");
+      if (override) {
+        return override(&loader, PyImport{import}).cast<uint64_t>();
+      }
+    }
+    return TargetSystem::symlink_import(loader, import);
+  }
 };
 
 struct PyNativeTargetSystem: public Engines::Native::TargetSystem {
@@ -108,8 +169,40 @@ struct PyNativeTargetSystem: public Engines::Native::TargetSystem {
       symlink,
       &loader, &sym);
   }
+
+  uint64_t symlink_import(Loader& loader, ImportView const& import) override {
+    {
+      py::gil_scoped_acquire gil;
+      py::function override = py::get_override(this, "symlink_import");
+      if (override) {
+        return override(&loader, PyImport{import}).cast<uint64_t>();
+      }
+    }
+    return TargetSystem::symlink_import(loader, import);
+  }
 };
 
+// Binds std::vector<T> as a read-only sequence. Its elements keep it alive.
+template <class T>
+void bind_list(py::module &m, const char *name, const char *doc) {
+  using List = std::vector<T>;
+  py::class_<List>(m, name, doc)
+      .def("__len__", &List::size)
+      .def("__getitem__",
+          [](const List &list, size_t idx) -> const T & {
+            if (idx >= list.size()) {
+              throw py::index_error{};
+            }
+            return list[idx];
+          },
+          py::return_value_policy::reference_internal)
+      .def("__iter__",
+          [](const List &list) {
+            return py::make_iterator(list.begin(), list.end());
+          },
+          py::keep_alive<0, 1>());
+}
+
 } // anonymous
 
 
@@ -127,6 +220,18 @@ PYBIND11_MODULE(pyqbdl, qbdl_module) {
   pyinit_arch(qbdl_module);
   pyinit_engine(qbdl_module);
   pyinit_loaders(qbdl_module);
+
+  qbdl_module.def("set_binding_profile_directory", &setBindingProfileDirectory,
+      "Set the directory where the binding profiles of ``BIND.PROFILE`` are stored",
+      "directory"_a);
+  qbdl_module.def("start_tracing", &startTracing,
+      "Start recording a timeline of the loading pipeline");
+  qbdl_module.def("stop_tracing", &stopTracing,
+      "Stop recording and write the timeline as a Chrome trace JSON file",
+      "path"_a);
+  qbdl_module.def("set_perf_map_enabled", &setPerfMapEnabled,
+      "Append the functions of the loaded binaries to ``/tmp/perf-<pid>.map``",
+      "enabled"_a);
 }
 
 void pyinit(py::module &m) {}
@@ -168,6 +273,9 @@ void pyinit_engine(py::module &m) {
     .def("mmap", &TargetMemory::mmap,
         "Function used by the loaders to allocate memory pages",
         "ptr"_a, "len"_a)
+    .def("munmap", &TargetMemory::munmap,
+        "Function used by the loaders to release memory pages allocated by mmap",
+        "ptr"_a, "len"_a)
     .def("mprotect", &TargetMemory::mprotect,
         "Function used by the loaders to change permissions on a memory area",
         "addr"_a, "len"_a, "prot"_a)
@@ -177,6 +285,16 @@ void pyinit_engine(py::module &m) {
         "Function used by the loaders to read data from memory")
     ;
 
+  py::class_<PyImport>(m, "Import", "Function imported by a PE binary")
+    .def_readonly("library", &PyImport::library, "Name of the imported DLL")
+    .def_readonly("name", &PyImport::name,
+        "Name of the imported function, empty if imported by ordinal")
+    .def_readonly("ordinal", &PyImport::ordinal)
+    .def_readonly("hint", &PyImport::hint,
+        "Index hint in the export name table of the DLL")
+    .def_readonly("by_ordinal", &PyImport::by_ordinal)
+    ;
+
   py::class_<TargetSystem, PyTargetSystem>(m, "TargetSystem")
     .def(py::init<TargetMemory&>(), py::keep_alive<1,2>())
     .def("symlink", &TargetSystem::symlink,
@@ -207,6 +325,26 @@ void pyinit_engine(py::module &m) {
         If it returns 0, the loader can choose any address.
         )pbdoc" ,
         "binary_base_address"_a, "virtual_size"_a)
+
+    .def("ifunc_resolve", &TargetSystem::ifunc_resolve,
+        R"pbdoc(
+        Callback used by the loader to run a GNU IFUNC resolver located at
+        ``resolver`` in the target. It must return the address of the
+        selected implementation.
+        )pbdoc" ,
+        "loader"_a, "resolver"_a)
+
+    .def("symlink_import",
+        [](TargetSystem& self, Loader& loader, PyImport const& import) {
+          return self.symlink_import(loader, import.view());
+        },
+        R"pbdoc(
+        Callback used by the PE loader to resolve an :class:`~.Import`.
+
+        The default implementation calls :meth:`symlink` with a symbol named
+        after the import, and returns 0 for imports by ordinal.
+        )pbdoc" ,
+        "loader"_a, "import"_a)
     ;
 
   py::module_ engines = m.def_submodule("engines");
@@ -243,6 +381,11 @@ void pyinit_engine(py::module &m) {
       )pbdoc");
   native.def("arch", &Engines::Native::arch,
       ":class:`~.Arch` object that matches the system on which QBDL is running on.");
+  native.def("init_thread_tls", &Engines::Native::init_thread_tls,
+      R"pbdoc(
+        Initialize, for the calling thread, the static TLS blocks of the
+        loaded binaries that use the initial-exec TLS model.
+      )pbdoc");
 
   py::class_<Engines::Native::TargetSystem, QBDL::TargetSystem, PyNativeTargetSystem>(native, "TargetSystem")
     .def(py::init<TargetMemory&>(), py::keep_alive<1,2>())
@@ -268,11 +411,45 @@ void pyinit_loaders(py::module &m) {
     ~PyLoader() override = default;
   };
 
+  py::class_<ImportSlot>(m, "ImportSlot", "Location that holds the address of an imported symbol")
+      .def_readonly("symbol", &ImportSlot::symbol, "Name of the imported symbol")
+      .def_readonly("address", &ImportSlot::address, "Absolute address of the slot")
+      .def_readonly("addend", &ImportSlot::addend,
+          "Value added to the address of the symbol before being stored into the slot")
+      .def_readonly("call_only", &ImportSlot::call_only,
+          "Whether the slot is only read to call the symbol");
+  bind_list<ImportSlot>(m, "ImportSlotList", "Read-only list of import slots, that keeps its loader alive");
+
+  py::class_<ImportStats>(m, "ImportStats", "Calls made to an imported function")
+      .def_readonly("symbol", &ImportStats::symbol, "Name of the imported symbol")
+      .def_readonly("target", &ImportStats::target, "Absolute address of the imported function")
+      .def_readonly("calls", &ImportStats::calls, "Number of calls, from all the threads")
+      .def_readonly("last_call", &ImportStats::last_call,
+          "Timestamp counter of the CPU at the last call, or 0");
+  bind_list<ImportStats>(m, "ImportStatsList", "Read-only list of call counters, that keeps its loader alive");
+
+  py::class_<ExportedSymbol> pyexport(m, "ExportedSymbol", "Symbol exported by a loaded binary");
+  py::enum_<ExportedSymbol::KIND>(pyexport, "KIND", "Kind of an exported symbol")
+      .value("FUNCTION", ExportedSymbol::KIND::FUNCTION, "Code")
+      .value("DATA", ExportedSymbol::KIND::DATA, "Variable")
+      .value("UNKNOWN", ExportedSymbol::KIND::UNKNOWN, "The binary does not tell");
+  pyexport
+      .def_readonly("name", &ExportedSymbol::name, "Name of the symbol")
+      .def_readonly("address", &ExportedSymbol::address, "Absolute address of the symbol")
+      .def_readonly("kind", &ExportedSymbol::kind, "Kind of the symbol");
+
+  bind_list<ExportedSymbol>(m, "ExportList", "Read-only view on the exports of a loader");
+
   py::class_<Loader, PyLoader> pyloader(m, "Loader", "Base class for all format loaders. See: :mod:`~pyqbdl.loaders`");
   py::enum_<Loader::BIND>(pyloader, "BIND", "Enum used to tweak the symbol binding mechanism")
       .value("NOT_BIND", Loader::BIND::NOT_BIND, "Do not bind symbol at all")
       .value("NOW", Loader::BIND::NOW, "Bind all the symbols while loading the binary")
-      .value("LAZY", Loader::BIND::LAZY, "Bind symbols when they are used (i.e lazily)");
+      .value("LAZY", Loader::BIND::LAZY, "Bind symbols when they are used (i.e lazily)")
+      .value("BACKGROUND", Loader::BIND::BACKGROUND,
+             "Bind symbols lazily, and resolve the remaining ones in a background thread")
+      .value("PROFILE", Loader::BIND::PROFILE,
+             "Eagerly bind the symbols used during previous loads, and the other ones lazily. "
+             "See :func:`~pyqbdl.set_binding_profile_directory`");
 
   pyloader
       .def("get_address", py::overload_cast<const std::string &>(
@@ -283,8 +460,40 @@ void pyinit_loaders(py::module &m) {
            py::overload_cast<uint64_t>(&Loader::get_address, py::const_),
            "Get the absolute address form the offset given in parameter",
            "offset"_a)
+      .def("get_addresses",
+          [](const Loader &loader, std::vector<std::string> const &names) {
+            std::vector<std::string_view> views{names.begin(), names.end()};
+            std::vector<uint64_t> addresses(names.size());
+            loader.get_addresses(views.data(), addresses.data(), views.size());
+            return addresses;
+          },
+          "Return the absolute addresses of a list of symbols (0 for the missing ones)",
+          "sym_names"_a)
+      .def("exports", &Loader::exports, py::return_value_policy::reference_internal,
+          "List the symbols exported by the binary, without copying them")
       .def_property_readonly("entrypoint", &Loader::entrypoint,
-          "Binary entrypoint as an **absolute** address");
+          "Binary entrypoint as an **absolute** address")
+      .def("import_slots", &Loader::import_slots, py::keep_alive<0, 1>(),
+          "List every GOT/IAT/symbol pointer slot of the loaded binary")
+      .def("rebind", &Loader::rebind,
+          "Redirect every import slot of a symbol to the given address, and return the number of patched slots",
+          "symbol"_a, "address"_a)
+      .def("instrument_imports", &Loader::instrument_imports,
+          "Redirect the resolved import slots to thunks that count the calls, and return the number of redirected slots",
+          "timestamps"_a = false)
+      .def("import_stats", &Loader::import_stats, py::keep_alive<0, 1>(),
+          "Read the call counters installed by :meth:`instrument_imports`")
+      .def("symbolize",
+          [](const Loader &loader, uint64_t address) -> py::object {
+            SymbolizedAddress result;
+            if (!loader.symbolize(address, result)) {
+              return py::none();
+            }
+            return py::make_tuple(std::string{result.name}, result.function,
+                                  result.offset);
+          },
+          "Return the ``(name, function address, offset)`` of the function containing an absolute address, or None",
+          "address"_a);
 
   py::module_ loaders = m.def_submodule("loaders");
   loaders.doc() = R"pbdoc(
@@ -317,7 +526,9 @@ void pyinit_loaders(py::module &m) {
         "bin_path"_a, "engines"_a, "bind"_a = Loader::BIND_DEFAULT,
         py::keep_alive<0, 2>())
     .def("is_valid", &Loaders::ELF::is_valid,
-        "Whether the loader object is consistent");
+        "Whether the loader object is consistent")
+    .def("bypass_plt", &Loaders::ELF::bypass_plt,
+        "Rewrite direct calls to PLT stubs into direct calls to the resolved symbols (x86-64 only)");
 
   py::class_<Loaders::PE, Loader>(loaders, "PE", "PE loader")
       .def_static("from_file", &Loaders::PE::from_file,
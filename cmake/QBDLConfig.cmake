@@ -1,2 +1,4 @@
 get_filename_component(QBDL_CMAKE_DIR "${CMAKE_CURRENT_LIST_FILE}" PATH)
+include(CMakeFindDependencyMacro)
+find_dependency(Threads)
 include("${QBDL_CMAKE_DIR}/QBDLTargets.cmake")
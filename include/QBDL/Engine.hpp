@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <string_view>
 
 namespace LIEF {
 class Symbol;
@@ -37,6 +38,17 @@ public:
    */
   virtual uint64_t mmap(uint64_t hint, size_t len) = 0;
 
+  /** Release a region of memory reserved by ::QBDL::TargetMemory::mmap.
+   *
+   * The default implementation does nothing and returns false.
+   *
+   * @param[in] addr Address returned by ::QBDL::TargetMemory::mmap
+   * @param[in] len Size of the memory region given to
+   * ::QBDL::TargetMemory::mmap
+   * @returns true iif the region has been released.
+   */
+  virtual bool munmap(uint64_t addr, size_t len);
+
   /** Change permissions on a region of memory.
    */
   virtual bool mprotect(uint64_t addr, size_t len, int prot) = 0;
@@ -87,6 +99,106 @@ public:
    * @returns The read pointer value
    */
   uint64_t read_ptr(Arch const &arch, uint64_t addr);
+
+  /** Write a pointer value to the targeted memory space, so that concurrent
+   * readers of \p addr see either the previous value or \p ptr.
+   *
+   * This is used to patch import slots (e.g. GOT entries) that can be read
+   * by running code at the same time. The default implementation calls
+   * ::QBDL::TargetMemory::write_ptr, which is enough for targets that are
+   * not accessed concurrently (e.g. emulators).
+   *
+   * @param[in] arch Targeted architecture
+   * @param[in] addr Virtual absolute address to write the pointer value into.
+   * It must be aligned on the pointer size.
+   * @param[in] ptr Value of the address to write
+   */
+  virtual void write_ptr_atomic(Arch const &arch, uint64_t addr, uint64_t ptr);
+};
+
+/** Describe how the target system handles thread-local storage (TLS).
+ *
+ * Each loaded binary with a `PT_TLS` segment is registered as a TLS module.
+ * Its blocks are then allocated per thread, either dynamically on first
+ * access through `__tls_get_addr`, or in a static area at a fixed offset
+ * from the thread pointer for binaries using the initial-exec model.
+ */
+QBDL_API class TargetTLS {
+public:
+  virtual ~TargetTLS() = default;
+
+  /** Register a new TLS module.
+   *
+   * @param[in] image Absolute virtual address of the TLS initialization image
+   * @param[in] image_size Size of the initialization image (`.tdata`)
+   * @param[in] mem_size Size of a TLS block (`.tdata` + `.tbss`)
+   * @param[in] align Alignment of a TLS block
+   * @returns The module ID, or 0 if an error occurred.
+   */
+  virtual uint64_t add_module(uint64_t image, uint64_t image_size,
+                              uint64_t mem_size, uint64_t align) = 0;
+
+  /** Mark a module as ready to be used, once its initialization image has
+   * been relocated.
+   */
+  virtual void activate_module(uint64_t module) = 0;
+
+  /** Unregister a module. Its blocks must not be accessed anymore. */
+  virtual void remove_module(uint64_t module) = 0;
+
+  /** Reserve a static TLS block for \p module.
+   *
+   * @param[in] module Module ID returned by ::QBDL::TargetTLS::add_module
+   * @param[out] offset Offset of the block from the thread pointer
+   * @returns false if no static block can be reserved.
+   */
+  virtual bool static_offset(uint64_t module, int64_t &offset) = 0;
+
+  /** Returns the absolute virtual address of the `__tls_get_addr`
+   * implementation that handles the registered modules.
+   */
+  virtual uint64_t get_addr_function() = 0;
+
+  /** Returns the absolute virtual address of a TLS descriptor resolver for
+   * static blocks, or 0 if TLS descriptors are not supported.
+   *
+   * The second word of the descriptor holds the offset of the variable from
+   * the thread pointer.
+   */
+  virtual uint64_t tlsdesc_static_function() = 0;
+
+  /** Returns the absolute virtual address of a TLS descriptor resolver for
+   * dynamic blocks, or 0 if they are not supported.
+   *
+   * The second word of the descriptor holds an argument allocated by
+   * ::QBDL::TargetTLS::tlsdesc_argument. The block of the calling thread is
+   * allocated and initialized on first access, like with `__tls_get_addr`.
+   */
+  virtual uint64_t tlsdesc_dynamic_function() = 0;
+
+  /** Allocate the argument of the dynamic TLS descriptor resolver for the
+   * variable at \p offset in the blocks of \p module. It is valid until the
+   * module is removed.
+   *
+   * @returns its absolute virtual address, or 0 if an error occurred.
+   */
+  virtual uint64_t tlsdesc_argument(uint64_t module, uint64_t offset) = 0;
+};
+
+/** Lightweight description of an import by a PE binary.
+ *
+ * The strings are owned by the loader and are only valid during the call
+ * they are given to.
+ */
+struct ImportView {
+  /** Name of the imported DLL */
+  std::string_view library;
+  /** Name of the imported function, empty if imported by ordinal */
+  std::string_view name;
+  uint16_t ordinal;
+  /** Index hint in the export name table of the DLL */
+  uint16_t hint;
+  bool by_ordinal;
 };
 
 /** Describe the target system the binary must be loaded into.
@@ -119,6 +231,53 @@ public:
    */
   virtual uint64_t symlink(Loader &loader, LIEF::Symbol const &sym) = 0;
 
+  /** Resolve a function imported by a PE binary.
+   *
+   * Imports of a DLL are resolved consecutively (by chunks when resolved
+   * concurrently), so that implementations can cache per-DLL lookups. The
+   * default implementation builds a `LIEF::Symbol` from the import name and
+   * calls ::QBDL::TargetSystem::symlink: override this function to avoid this
+   * allocation, or to support imports by ordinal (the default implementation
+   * returns 0 for them).
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @param[in] import The import to resolve
+   * @returns The absolute virtual address of \p import
+   */
+  virtual uint64_t symlink_import(Loader &loader, ImportView const &import);
+
+  /** Tell whether ::QBDL::TargetSystem::symlink and
+   * ::QBDL::TargetSystem::symlink_import can be called concurrently.
+   *
+   * If so, BIND::NOW resolves the imports of large binaries with a pool of
+   * threads, and writes the resolved addresses once they are all known.
+   * The default implementation returns false.
+   */
+  virtual bool thread_safe_symlink();
+
+  /** Tell whether the loaded code runs in the process of QBDL itself.
+   *
+   * If so, loaders can make it call functions of QBDL (e.g. to resolve PE
+   * delay-load imports on their first call). The default implementation
+   * returns false.
+   */
+  virtual bool executes_on_host();
+
+  /** Select the implementation of an indirect function (IFUNC).
+   *
+   * This is called for `R_*_IRELATIVE` relocations and for symbols of type
+   * `STT_GNU_IFUNC` defined by the loaded binary. Implementations must call
+   * (or emulate a call to) the resolver at \p resolver with the arguments
+   * the target system would give it (e.g. hwcaps), and return its result.
+   *
+   * The default implementation does not support IFUNCs and returns 0.
+   *
+   * @param[in] loader The current loader object that is calling this function
+   * @param[in] resolver Absolute virtual address of the IFUNC resolver
+   * @returns The absolute virtual address of the selected implementation
+   */
+  virtual uint64_t ifunc_resolve(Loader &loader, uint64_t resolver);
+
   /** Verify that the target system supports a binary.
    *
    * This is mainly used by the ::QBDL::Loaders::MachO loader to
@@ -143,6 +302,11 @@ public:
   virtual uint64_t base_address_hint(uint64_t binary_base_address,
                                      uint64_t virtual_size) = 0;
 
+  /** Returns the thread-local storage handler of the target system, or
+   * nullptr if TLS relocations are not supported (the default).
+   */
+  virtual TargetTLS *tls();
+
   TargetMemory &mem() { return mem_; }
 
 private:
@@ -4,24 +4,201 @@
 #include <QBDL/arch.hpp>
 #include <QBDL/exports.hpp>
 #include <QBDL/macros.hpp>
+#include <QBDL/symbol.hpp>
 
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace QBDL {
 class TargetSystem;
 
+/** Location of the loaded binary that holds the address of an imported
+ * symbol: a GOT entry for ELF, an IAT entry for PE, or a symbol pointer for
+ * MachO.
+ */
+struct ImportSlot {
+  /** Name of the imported symbol. It is valid as long as the loader that
+   * returned this object lives.
+   */
+  std::string_view symbol;
+
+  /** Absolute virtual address of the slot
+   */
+  uint64_t address;
+
+  /** Value added to the address of the symbol before being stored into the
+   * slot
+   */
+  int64_t addend;
+
+  /** Whether the slot is only read to call the symbol (PLT GOT entry, lazy
+   * symbol pointer, IAT entry), so that it can point to a stub of the symbol
+   * instead of the symbol itself.
+   */
+  bool call_only;
+};
+
+/** Calls made to an imported function, as counted by the thunks installed by
+ * ::QBDL::Loader::instrument_imports
+ */
+struct ImportStats {
+  /** Name of the imported symbol. It is valid as long as the loader that
+   * returned this object lives.
+   */
+  std::string_view symbol;
+
+  /** Absolute virtual address of the imported function
+   */
+  uint64_t target;
+
+  /** Number of calls, from all the threads
+   */
+  uint64_t calls;
+
+  /** Timestamp counter of the CPU (`rdtsc`) at the last call, or 0 if no
+   * call has been made or timestamps are not recorded
+   */
+  uint64_t last_call;
+};
+
+/** A function defined by the loaded binary
+ */
+struct FunctionSymbol {
+  /** Name of the function. It is valid as long as the loader that returned
+   * this object lives.
+   */
+  std::string_view name;
+
+  /** Absolute virtual address of the function
+   */
+  uint64_t address;
+
+  /** Size of the function in bytes, or 0 if the binary does not record it
+   */
+  uint64_t size;
+};
+
+/** A symbol exported by the loaded binary
+ */
+struct ExportedSymbol {
+  enum class KIND {
+    FUNCTION, ///< Code
+    DATA,     ///< Variable
+    UNKNOWN,  ///< The binary does not tell
+  };
+
+  /** Name of the symbol. It is valid as long as the loader that returned
+   * this object lives.
+   */
+  std::string_view name;
+
+  /** Absolute virtual address of the symbol
+   */
+  uint64_t address;
+
+  KIND kind;
+};
+
+/** Function containing an address, as found by ::QBDL::Loader::symbolize
+ */
+struct SymbolizedAddress {
+  /** Name of the function. It is valid as long as the loader that returned
+   * this object lives.
+   */
+  std::string_view name;
+
+  /** Absolute virtual address of the function
+   */
+  uint64_t function;
+
+  /** Offset of the address in the function
+   */
+  uint64_t offset;
+};
+
+class ExportIndex;
+class ImportThunks;
+class SymbolIndex;
+
 /** Base class for a Loader
  */
 class QBDL_API Loader {
 public:
-  enum class BIND { NOT_BIND, NOW, LAZY };
+  /** Binding modes.
+   *
+   * BIND::BACKGROUND sets up lazy binding like BIND::LAZY, and then resolves
+   * the remaining symbols in a background thread. This means that
+   * ::QBDL::TargetSystem::symlink is called from this thread, and must be
+   * reentrant.
+   *
+   * BIND::PROFILE eagerly binds the symbols that have been lazily resolved
+   * during previous loads of the same binary, and leaves the other ones lazy.
+   * See ::QBDL::setBindingProfileDirectory.
+   */
+  enum class BIND { NOT_BIND, NOW, LAZY, BACKGROUND, PROFILE };
   static constexpr inline BIND BIND_DEFAULT = BIND::NOW;
 
+  /** Loading stages, in the order in which they must be performed.
+   *
+   * A loader returned by the `plan()` functions of the format loaders is in
+   * the STAGE::PLANNED stage: the binary has been parsed and its memory
+   * layout computed, but nothing has been done in the target system yet.
+   */
+  enum class STAGE { PLANNED, RESERVED, MAPPED, RELOCATED, BOUND };
+
 public:
   /** Get the resolved absolute virtual address of a symbol.
    */
   virtual uint64_t get_address(const std::string &sym) const = 0;
 
+  /** Same as `get_address(const std::string&)`, but exported symbols are
+   * found with the precomputed hash of \p sym, without hashing \p sym or
+   * allocating.
+   */
+  uint64_t get_address(SymbolHandle const &sym) const;
+
+  /** Get a pointer to the function \p sym, of type \p F (e.g.
+   * `int(const char *)`).
+   *
+   * This is only meaningful when the binary is loaded in the current process
+   * (e.g. with the native engine).
+   *
+   * @returns nullptr if \p sym is not found
+   */
+  template <class F> F *get_function(SymbolHandle const &sym) const {
+    static_assert(std::is_function_v<F>, "F must be a function type");
+    return reinterpret_cast<F *>(static_cast<uintptr_t>(get_address(sym)));
+  }
+
+  /** Get the resolved absolute virtual addresses of \p count symbols.
+   *
+   * Exported symbols (see `exports()`) are found in a hash table, without
+   * allocating. The other names are looked up with
+   * `get_address(const std::string&)`. Addresses of missing symbols are 0.
+   *
+   * @param[in] names Names of the symbols
+   * @param[out] addresses Array of \p count addresses
+   * @param[in] count Number of symbols
+   */
+  void get_addresses(std::string_view const *names, uint64_t *addresses,
+                     size_t count) const;
+
+  /** List the symbols exported by the binary (the dynamic symbol table for
+   * ELF, the export trie for MachO and the export table for PE).
+   *
+   * The list, and the index used by `get_addresses()`, are built on the
+   * first call once the binary has been reserved. Before that, the list is
+   * empty and an error is logged. This can be called concurrently.
+   */
+  std::vector<ExportedSymbol> const &exports() const;
+
   /** Compute the absolute virtual address of on offset. This is basically
    * `base_address + offset`.
    */
@@ -43,16 +220,174 @@ public:
    */
   bool contains_address(uint64_t ptr) const;
 
+  /** Find the function of the binary that contains \p address.
+   *
+   * Functions come from the symbol tables of the binary (the exports for
+   * PE). The first call builds a sorted index of these functions, and the
+   * following ones are binary searches in this index, that do not allocate.
+   * This can be called concurrently, once the binary has been reserved.
+   *
+   * @param[in] address Absolute virtual address to symbolize
+   * @param[out] result Function containing \p address
+   * @returns false if no known function contains \p address.
+   */
+  bool symbolize(uint64_t address, SymbolizedAddress &result) const;
+
   virtual ~Loader();
 
   /** Get the architecture targeted by the loaded binary.
    */
   virtual Arch arch() const = 0;
 
+  /** Reserve the memory region that will receive the binary, using
+   * ::QBDL::TargetMemory::mmap. The region is then registered in the
+   * process-wide registry of images (see ::QBDL::findLoadedImage).
+   *
+   * Stage: STAGE::PLANNED -> STAGE::RESERVED
+   * @returns true on success
+   */
+  virtual bool reserve() = 0;
+
+  /** Copy the content of the binary's segments into the reserved memory.
+   *
+   * Stage: STAGE::RESERVED -> STAGE::MAPPED
+   * @returns true on success
+   */
+  virtual bool map() = 0;
+
+  /** Apply the relocations that do not involve external symbols.
+   *
+   * Stage: STAGE::MAPPED -> STAGE::RELOCATED
+   * @returns true on success
+   */
+  virtual bool relocate() = 0;
+
+  /** Bind external symbols according to \p binding.
+   *
+   * Stage: STAGE::RELOCATED -> STAGE::BOUND
+   * @returns true on success
+   */
+  virtual bool bind(BIND binding) = 0;
+
+  /** Run all the remaining loading stages.
+   *
+   * This is what the `from_binary` and `from_file` functions of the format
+   * loaders do. Each stage can also be called individually, so that a
+   * scheduler can interleave the stages of several binaries.
+   *
+   * @returns true on success
+   */
+  bool load(BIND binding);
+
+  /** Get the last stage that has been successfully performed.
+   */
+  STAGE stage() const { return stage_; }
+
+  /** List every import slot of the loaded binary. PE imports by ordinal
+   * have no name, and are not listed.
+   */
+  virtual std::vector<ImportSlot> import_slots() const = 0;
+
+  /** Redirect every import slot of \p symbol to \p address.
+   *
+   * Slots are patched with ::QBDL::TargetMemory::write_ptr_atomic, so this
+   * can be done while the loaded binary is running. \p symbol must not be
+   * empty: slots imported by ordinal have no name and can't be rebound.
+   *
+   * @returns the number of patched slots
+   */
+  virtual size_t rebind(std::string_view symbol, uint64_t address);
+
+  /** Count the calls made by the loaded binary to its imported functions.
+   *
+   * The resolved call-only import slots (see ::QBDL::ImportSlot::call_only)
+   * are redirected to generated thunks, that count the calls and jump to the
+   * imported functions. Slots that are not resolved yet (lazy binding) or
+   * that point into the binary itself are left untouched, so this should be
+   * used with BIND::NOW. Slots redirected afterwards by `rebind()` are not
+   * counted anymore.
+   *
+   * Thunks are supported on x86-64 and AArch64 targets. With \p timestamps,
+   * they also record the timestamp counter of the CPU at each call (x86-64
+   * only).
+   *
+   * Stage: STAGE::BOUND
+   * @returns the number of redirected slots
+   */
+  size_t instrument_imports(bool timestamps = false);
+
+  /** Read the call counters of the thunks installed by `instrument_imports()`,
+   * one per imported symbol and target address.
+   */
+  std::vector<ImportStats> import_stats() const;
+
+  /** Wait for the background binding thread started by BIND::BACKGROUND to
+   * finish. Does nothing if there is no such thread. It is safe to call from
+   * several threads at once.
+   */
+  void wait_binding();
+
 protected:
   Loader();
   Loader(TargetSystem &engine);
+
+  /** Checks that the loader is in stage \p expected, and logs an error
+   * otherwise.
+   */
+  bool check_stage(STAGE expected) const;
+
+  /** List the functions defined by the binary, from its symbol tables.
+   *
+   * This is used to describe the loaded binary to profilers (see
+   * ::QBDL::setPerfMapEnabled). The default implementation returns an empty
+   * list.
+   */
+  virtual std::vector<FunctionSymbol> function_symbols() const;
+
+  /** List the symbols exported by the binary, for `exports()`. The default
+   * implementation returns an empty list.
+   */
+  virtual std::vector<ExportedSymbol> exported_symbols() const;
+
+  /** Builds the index of `exports()` on the first call. Returns nullptr
+   * before the binary is reserved.
+   */
+  const ExportIndex *export_index() const;
+
+  /** Registers the reserved memory region in the process-wide registry of
+   * images. Must be called by the implementations of `reserve()`.
+   */
+  void register_image();
+
+  /** Run \p binder in a background thread.
+   *
+   * \p binder must regularly check `background_binding_stopped()`, and
+   * return when it is true. Derived classes must call
+   * `stop_background_binding()` in their destructors, before the data used by
+   * \p binder is destroyed.
+   */
+  void start_background_binding(std::function<void()> binder);
+  void stop_background_binding();
+  bool background_binding_stopped() const {
+    return binder_stop_.load(std::memory_order_relaxed);
+  }
+
   TargetSystem *engine_{nullptr};
+  STAGE stage_{STAGE::PLANNED};
+
+private:
+  bool run_stages(BIND binding);
+
+  std::mutex binder_mutex_; // Guards binder_
+  std::thread binder_;
+  std::atomic<bool> binder_stop_{false};
+  bool registered_{false};
+  mutable std::once_flag symbol_index_once_;
+  mutable std::unique_ptr<SymbolIndex> symbol_index_;
+  mutable std::once_flag export_index_once_;
+  mutable std::unique_ptr<ExportIndex> export_index_;
+  std::unique_ptr<ImportThunks> import_thunks_;
+  std::vector<ImportStats> instrumented_;
 
 private:
   DISALLOW_COPY_AND_ASSIGN(Loader);
@@ -21,9 +21,12 @@ namespace QBDL::Engines::Native {
 QBDL_API class TargetMemory : public QBDL::TargetMemory {
 public:
   uint64_t mmap(uint64_t hint, size_t len) override;
+  bool munmap(uint64_t addr, size_t len) override;
   bool mprotect(uint64_t addr, size_t len, int prot) override;
   void write(uint64_t addr, const void *buf, size_t len) override;
   void read(void *dst, uint64_t addr, size_t len) override;
+  void write_ptr_atomic(Arch const &arch, uint64_t addr,
+                        uint64_t ptr) override;
 };
 
 /** Allocates and returns a ::QBDL::Engines::Native::TargetMemory object.
@@ -38,10 +41,43 @@ public:
   using QBDL::TargetSystem::TargetSystem;
 
   bool supports(LIEF::Binary const &bin) override;
+
+  /** Calls the IFUNC resolver with the hwcaps of the host, like the system
+   * dynamic loader would.
+   */
+  uint64_t ifunc_resolve(Loader &loader, uint64_t resolver) override;
+
+  /** On Windows, resolves the import (by name or by ordinal) with
+   * `GetProcAddress` in the DLL loaded by the host, and falls back to
+   * ::QBDL::TargetSystem::symlink_import if it is not found. Elsewhere, this
+   * is ::QBDL::TargetSystem::symlink_import.
+   */
+  uint64_t symlink_import(Loader &loader,
+                          QBDL::ImportView const &import) override;
+
   uint64_t base_address_hint(uint64_t binary_base_address,
                              uint64_t virtual_size) override;
+
+  bool executes_on_host() override;
+
+  /** Returns the TLS handler shared by every native loader, or nullptr if
+   * thread-local storage is not supported on this host (only Linux x86-64
+   * and AArch64 are).
+   */
+  QBDL::TargetTLS *tls() override;
 };
 
+/** Initializes, for the calling thread, the static TLS blocks of the loaded
+ * binaries that use the initial-exec TLS model.
+ *
+ * These blocks are otherwise initialized on the first `__tls_get_addr` call
+ * of each thread, which initial-exec code may never do. It is not needed for
+ * the thread that loaded the binaries, nor for the binaries that only use the
+ * dynamic models (`__tls_get_addr` or TLS descriptors), whose blocks are
+ * initialized on first access.
+ */
+QBDL_API void init_thread_tls();
+
 namespace details {
 static inline constexpr LIEF::ARCHITECTURES LIEFArch() {
 #if defined(__arm__)
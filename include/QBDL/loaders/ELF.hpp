@@ -1,6 +1,8 @@
 #ifndef QBDL_LOADER_ELF_H_
 #define QBDL_LOADER_ELF_H_
+#include <atomic>
 #include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -17,12 +19,29 @@ class Symbol;
 
 namespace QBDL {
 struct Arch;
+class BindingProfile;
 } // namespace QBDL
 
 namespace QBDL::Loaders {
 
 class QBDL_API ELF : public Loader {
 public:
+  /** Parses an ELF file from a LIEF object and computes its memory layout,
+   * without touching the target system.
+   *
+   * The returned object is in the STAGE::PLANNED stage. Use
+   * ::QBDL::Loader::load or the individual stages to actually load it.
+   *
+   * @param[in] bin a valid `LIEF::ELF::Binary` object. The returned object
+   * takes ownership.
+   * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
+   * ELF object does *not* own this reference.
+   * @returns A ::QBDL::Loaders::ELF object, or nullptr if \p bin is not
+   * supported.
+   */
+  static std::unique_ptr<ELF> plan(std::unique_ptr<LIEF::ELF::Binary> bin,
+                                   TargetSystem &engine);
+
   /** Loads an ELF file directly from a LIEF object.
    *
    * This function also loads the binary into \p engine, and return an :ELF
@@ -50,7 +69,9 @@ public:
    * ELF object does *not* own this reference. It is the responsibility of the
    * user to ensure this object lives as long as the returned ELF object lives.
    * @param[in] binding Binding mode. Note that BIND::LAZY is only supported
-   * with a native engine.
+   * with a native engine. Lazily bound symbols can be resolved concurrently
+   * from several threads: in this case, ::QBDL::TargetSystem::symlink might
+   * be called more than once for the same symbol, and must be reentrant.
    * @returns An ::QBDL::Loaders::ELF object, or nullptr if loading failed.
    */
   static std::unique_ptr<ELF> from_file(const char *path, TargetSystem &engine,
@@ -60,6 +81,7 @@ public:
 
   inline bool is_valid() const { return this->bin_ != nullptr; }
 
+  using Loader::get_address;
   uint64_t get_address(const std::string &sym) const override;
   uint64_t get_address(uint64_t offset) const override;
   uint64_t entrypoint() const override;
@@ -67,21 +89,78 @@ public:
   uint64_t mem_size() const override { return mem_size_; }
   Arch arch() const override;
 
+  bool reserve() override;
+  bool map() override;
+  bool relocate() override;
+  bool bind(BIND binding) override;
+
+  std::vector<ImportSlot> import_slots() const override;
+  size_t rebind(std::string_view symbol, uint64_t address) override;
+
+  /** Same as ::QBDL::Loader::reserve, but tries to map the binary right below
+   * the first imported symbol, so that bypass_plt() can reach its imports
+   * with 32-bit displacements.
+   *
+   * This resolves the first PLT import with ::QBDL::TargetSystem::symlink,
+   * and ignores ::QBDL::TargetSystem::base_address_hint.
+   */
+  bool reserve_near_imports();
+
+  /** Rewrite the `call rel32` and `jmp rel32` instructions that target a PLT
+   * stub into direct calls (resp. jumps) to the resolved symbols, when they
+   * are within reach of a 32-bit displacement.
+   *
+   * This is an opt-in pass for x86-64 binaries, that must be run after the
+   * binding stage and before running the loaded code. Slots that are not
+   * resolved yet (lazy binding) are left untouched. Stubs of .plt, .plt.sec
+   * and .plt.got are handled.
+   *
+   * Call sites are found by decoding the functions of the symbol tables from
+   * their start, so code without a sized function symbol is not patched, and
+   * the decoding of a function stops at the first unsupported instruction.
+   *
+   * The patched call sites no longer go through the GOT: they are not
+   * redirected by rebind() and their calls are not counted by
+   * instrument_imports().
+   *
+   * @returns the number of patched instructions
+   */
+  size_t bypass_plt();
+
   LIEF::ELF::Binary &get_binary() { return *bin_; }
   const LIEF::ELF::Binary &get_binary() const { return *bin_; }
 
   ~ELF() override;
 
+protected:
+  std::vector<FunctionSymbol> function_symbols() const override;
+  std::vector<ExportedSymbol> exported_symbols() const override;
+
 private:
   static uintptr_t dl_resolve(void *loader, uintptr_t symidx);
   using relocator_t = void (ELF::*)(const LIEF::ELF::Relocation &);
   void reloc_x86_64(const LIEF::ELF::Relocation &reloc);
   void reloc_aarch64(const LIEF::ELF::Relocation &reloc);
-  void bind_lazy(relocator_t relocator);
+  bool bind_lazy();
   void bind_now(relocator_t relocator);
+  void bind_slots(const std::vector<const LIEF::ELF::Relocation *> &relocs);
+  uintptr_t resolve_slot(size_t idx);
+  uintptr_t publish_slot(size_t idx, uint64_t sym_addr);
+  std::vector<size_t> bind_local_slots();
+  void bind_profile();
+  void save_profile();
+  uint64_t binary_hash() const;
+  bool is_import_slot(const LIEF::ELF::Relocation &reloc) const;
+  bool is_jump_slot(const LIEF::ELF::Relocation &reloc) const;
+  bool is_copy(const LIEF::ELF::Relocation &reloc) const;
+  enum class TLS_RELOC { DTPMOD, DTPOFF, TPOFF, TLSDESC };
+  void reloc_tls(const LIEF::ELF::Relocation &reloc, TLS_RELOC kind);
+  void register_tls();
+  void apply_irelative();
   uint64_t get_rva(const LIEF::ELF::Binary &bin, uint64_t addr) const;
-  void load(BIND binding);
+  bool reserve_at(uint64_t base_address_hint);
   uintptr_t resolve(const LIEF::ELF::Symbol &sym);
+  uintptr_t resolve_local(const LIEF::ELF::Symbol &sym);
   uintptr_t resolve_or_symlink(const LIEF::ELF::Symbol &sym);
 
   ELF(std::unique_ptr<LIEF::ELF::Binary> bin, TargetSystem &engines);
@@ -89,8 +168,36 @@ private:
   std::unique_ptr<LIEF::ELF::Binary> bin_;
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
+  relocator_t relocator_{nullptr};
   std::unordered_map<std::string, LIEF::ELF::Symbol *>
       sym_exp_; // Cache to speed-up symbol resolution
+  std::unordered_map<std::string_view, const LIEF::ELF::Symbol *>
+      sym_all_; // Read-only index used by get_address
+
+  // PLT/GOT relocations, indexed like the lazy binding stubs index them, and
+  // the resolved address of each slot (0 if not resolved yet).
+  std::vector<const LIEF::ELF::Relocation *> plt_relocs_;
+  std::unique_ptr<std::atomic<uint64_t>[]> plt_slots_;
+  uint64_t pltgot_rva_{0};
+
+  // Dynamic relocations against symbols (import slots and copies), that
+  // relocate() leaves to bind()
+  std::vector<const LIEF::ELF::Relocation *> symbol_relocs_;
+
+  // IRELATIVE relocations, applied once every other relocation is done
+  std::vector<const LIEF::ELF::Relocation *> irelative_relocs_;
+
+  // TLS module ID given by the target system, 0 if none
+  uint64_t tls_module_{0};
+  // Whether the TLS module has a static block (initial-exec model), that its
+  // TLS descriptors use instead of the dynamic resolver
+  bool tls_static_{false};
+
+  // BIND::PROFILE: first-touch order of each PLT slot (0 if not touched)
+  std::unique_ptr<BindingProfile> profile_;
+  std::string profile_path_;
+  std::unique_ptr<std::atomic<uint32_t>[]> plt_touch_;
+  std::atomic<uint32_t> touch_seq_{0};
 };
 } // namespace QBDL::Loaders
 
@@ -1,6 +1,7 @@
 #ifndef QBDL_LOADER_MACHO_H_
 #define QBDL_LOADER_MACHO_H_
 #include <memory>
+#include <vector>
 
 #include <QBDL/Loader.hpp>
 #include <QBDL/exports.hpp>
@@ -8,15 +9,35 @@
 namespace LIEF::MachO {
 class Binary;
 class FatBinary;
+class Relocation;
+class Symbol;
 } // namespace LIEF::MachO
 
 namespace QBDL {
 struct Arch;
+class ChainedFixups;
+class FixupBatch;
 } // namespace QBDL
 
 namespace QBDL::Loaders {
 class QBDL_API MachO : public Loader {
 public:
+  /** Parses a MachO file from a LIEF object and computes its memory layout,
+   * without touching the target system.
+   *
+   * The returned object is in the STAGE::PLANNED stage. Use
+   * ::QBDL::Loader::load or the individual stages to actually load it.
+   *
+   * @param[in] bin a valid `LIEF::MachO::Binary` object. The returned object
+   * takes ownership.
+   * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
+   * MachO object does *not* own this reference.
+   * @returns A ::QBDL::Loaders::MachO object, or nullptr if \p bin is not
+   * supported.
+   */
+  static std::unique_ptr<MachO> plan(std::unique_ptr<LIEF::MachO::Binary> bin,
+                                     TargetSystem &engine);
+
   /** Loads a MachO file directly from a LIEF object.
    *
    * This function also loads the binary into \p engine, and return a :MachO
@@ -62,7 +83,9 @@ public:
    * user to ensure this object lives as long as the returned MachO object
    * lives.
    * @param[in] binding Binding mode. Note that BIND::LAZY is only supported
-   * with a native engine.
+   * with a native engine. With BIND::BACKGROUND, lazy bindings are resolved
+   * by a background thread, and the lazy symbol pointers go through
+   * `dyld_stub_binder` until then.
    * @returns An ::QBDL::Loaders::MachO object, or nullptr if loading failed.
    */
   static std::unique_ptr<MachO> from_file(const char *path, Arch const &arch,
@@ -73,6 +96,7 @@ public:
 
   inline bool is_valid() const { return this->bin_ != nullptr; }
 
+  using Loader::get_address;
   uint64_t get_address(const std::string &sym) const override;
   uint64_t get_address(uint64_t offset) const override;
   uint64_t entrypoint() const override;
@@ -80,20 +104,50 @@ public:
   uint64_t mem_size() const override { return mem_size_; }
   Arch arch() const override;
 
+  bool reserve() override;
+  bool map() override;
+  bool relocate() override;
+  bool bind(BIND binding) override;
+
+  std::vector<ImportSlot> import_slots() const override;
+
   ~MachO() override;
 
+protected:
+  std::vector<FunctionSymbol> function_symbols() const override;
+  std::vector<ExportedSymbol> exported_symbols() const override;
+
 private:
-  void bind_now();
+  struct ChainedBind {
+    uint64_t rva;
+    uint32_t import;
+    int64_t addend;
+  };
+
+  void bind_now(bool lazy, bool atomic);
+  bool parse_chained_fixups();
+  bool apply_chained_fixups();
+  void bind_chained();
+  bool relocate_section(const LIEF::MachO::Relocation &reloc,
+                        const LIEF::MachO::Relocation *subtractor,
+                        uint64_t sym_addr, FixupBatch &batch);
+  bool bind_section_relocs();
   uint64_t get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const;
   LIEF::MachO::Binary &get_binary() { return *bin_; }
   const LIEF::MachO::Binary &get_binary() const { return *bin_; }
-  bool load(BIND binding);
 
   MachO(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine);
 
   std::unique_ptr<LIEF::MachO::Binary> bin_;
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
+
+  // LC_DYLD_CHAINED_FIXUPS, and the binds found while rebasing
+  std::unique_ptr<ChainedFixups> chained_fixups_;
+  std::vector<ChainedBind> chained_binds_;
+
+  // Section relocations against imported symbols, applied by bind()
+  std::vector<const LIEF::MachO::Relocation *> import_relocs_;
 };
 } // namespace QBDL::Loaders
 
@@ -1,6 +1,7 @@
 #ifndef QBDL_LOADER_PE_H_
 #define QBDL_LOADER_PE_H_
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -20,6 +21,22 @@ namespace QBDL::Loaders {
 
 class QBDL_API PE : public Loader {
 public:
+  /** Parses a PE file from a LIEF object and computes its memory layout,
+   * without touching the target system.
+   *
+   * The returned object is in the STAGE::PLANNED stage. Use
+   * ::QBDL::Loader::load or the individual stages to actually load it.
+   *
+   * @param[in] bin a valid `LIEF::PE::Binary` object. The returned object
+   * takes ownership.
+   * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
+   * PE object does *not* own this reference.
+   * @returns A ::QBDL::Loaders::PE object, or nullptr if \p bin is not
+   * supported.
+   */
+  static std::unique_ptr<PE> plan(std::unique_ptr<LIEF::PE::Binary> bin,
+                                  TargetSystem &engine);
+
   /** Loads an PE file directly from a LIEF object.
    *
    * This function also loads the binary into \p engine, and return an :PE
@@ -30,8 +47,10 @@ public:
    * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
    * PE object does *not* own this reference. It is the responsibility of the
    * user to ensure this object lives as long as the returned PE object lives.
-   * @param[in] binding Binding mode. Note that the current implementation only
-   * supports BIND::NOW.
+   * @param[in] binding Binding mode. Regular imports are always bound
+   * eagerly. With BIND::LAZY, delay-load imports are resolved on their first
+   * call (x86-64 engines that execute the binary on the host only, see
+   * ::QBDL::TargetSystem::executes_on_host; BIND::NOW is used otherwise).
    * @returns A ::QBDL::Loaders::PE object, or nullptr if loading failed.
    */
   static std::unique_ptr<PE> from_binary(std::unique_ptr<LIEF::PE::Binary> bin,
@@ -47,8 +66,7 @@ public:
    * @param[in] engine Reference to a ::QBDL::TargetSystem object. The returned
    * PE object does *not* own this reference. It is the responsibility of the
    * user to ensure this object lives as long as the returned PE object lives.
-   * @param[in] binding Binding mode. Note that the current implementation only
-   * supports BIND::DEFAULT and BIND::NOW.
+   * @param[in] binding Binding mode. See ::QBDL::Loaders::PE::from_binary.
    * @returns An ::QBDL::Loaders::PE object, or nullptr if loading failed.
    */
   static std::unique_ptr<PE> from_file(const char *path, TargetSystem &engine,
@@ -58,6 +76,7 @@ public:
 
   inline bool is_valid() const { return this->bin_ != nullptr; }
 
+  using Loader::get_address;
   uint64_t get_address(const std::string &sym) const override;
   uint64_t get_address(uint64_t offset) const override;
 
@@ -67,14 +86,41 @@ public:
   uint64_t mem_size() const override { return mem_size_; }
   Arch arch() const override;
 
+  bool reserve() override;
+  bool map() override;
+  bool relocate() override;
+  bool bind(BIND binding) override;
+
+  std::vector<ImportSlot> import_slots() const override;
+
   LIEF::PE::Binary &get_binary() { return *bin_; }
   const LIEF::PE::Binary &get_binary() const { return *bin_; }
 
   ~PE() override;
 
+protected:
+  std::vector<FunctionSymbol> function_symbols() const override;
+  std::vector<ExportedSymbol> exported_symbols() const override;
+
 private:
+  // Entry of the delay-load import table
+  struct DelayImport {
+    std::string dll;
+    std::string name;
+    uint16_t ordinal;
+    uint16_t hint;
+    bool by_ordinal;
+    uint64_t iat_rva;
+  };
+
+  static uintptr_t delay_resolve(void *loader, uintptr_t index);
+  bool parse_delay_imports();
+  uint64_t resolve_delay_import(size_t index);
+  void bind_delay_now(bool atomic);
+  bool bind_delay_lazy();
+  std::string read_string(uint64_t addr);
+
   uint64_t get_rva(const LIEF::PE::Binary &bin, uint64_t addr) const;
-  void load(BIND binding);
   uintptr_t resolve(const LIEF::PE::Symbol &sym);
 
   PE(std::unique_ptr<LIEF::PE::Binary> bin, TargetSystem &engines);
@@ -82,6 +128,10 @@ private:
   std::unique_ptr<LIEF::PE::Binary> bin_;
   uint64_t base_address_{0};
   uint64_t mem_size_{0};
+  std::vector<DelayImport> delay_imports_;
+  // Page of the lazy delay-load thunks, if any
+  uint64_t delay_thunks_{0};
+  size_t delay_thunks_size_{0};
 };
 } // namespace QBDL::Loaders
 
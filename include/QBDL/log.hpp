@@ -1,6 +1,12 @@
 #ifndef QBDL_LOG_H_
 #define QBDL_LOG_H_
 
+#include <QBDL/exports.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+
 namespace QBDL {
 
 enum LogLevel : int {
@@ -12,7 +18,28 @@ enum LogLevel : int {
   critical,
 };
 
-void setLogLevel(LogLevel level);
+/** Receives the messages logged by QBDL, without trailing newline. */
+using LogHandler = std::function<void(LogLevel level, std::string_view msg)>;
+
+QBDL_API void setLogLevel(LogLevel level);
+
+/** Send the messages to \p handler instead of stdout, or back to stdout if
+ * \p handler is empty. With asynchronous logging, \p handler is called from
+ * the logging thread.
+ */
+QBDL_API void setLogHandler(LogHandler handler);
+
+/** Format and output the messages from a background thread, through a queue
+ * of \p queue_size messages. When the queue is full, the oldest messages are
+ * dropped. A size of 0 goes back to synchronous logging (the default).
+ *
+ * This can be called while other threads log: their messages go to the
+ * previous logger until their call returns.
+ */
+QBDL_API void setLogAsync(size_t queue_size);
+
+/** Wait for the queued messages to be output. */
+QBDL_API void flushLog();
 
 } // namespace QBDL
 
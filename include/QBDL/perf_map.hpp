@@ -0,0 +1,24 @@
+#ifndef QBDL_PERF_MAP_H_
+#define QBDL_PERF_MAP_H_
+
+#include <QBDL/exports.hpp>
+
+namespace QBDL {
+
+/** Describe the loaded binaries to `perf` and to the profilers that read
+ * perf maps.
+ *
+ * When enabled, each time ::QBDL::Loader::load finishes, the functions
+ * defined by the loaded binary are appended to `/tmp/perf-<pid>.map`, at
+ * their loaded addresses. Functions are taken from the ELF symbol tables,
+ * the Mach-O symbol table, or the PE exports.
+ *
+ * This is only meaningful when binaries are loaded in the current process
+ * (e.g. with the native engine), and is only supported on Linux. Disabled
+ * by default.
+ */
+QBDL_API void setPerfMapEnabled(bool enabled);
+
+} // namespace QBDL
+
+#endif
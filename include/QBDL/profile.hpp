@@ -0,0 +1,25 @@
+#ifndef QBDL_PROFILE_H_
+#define QBDL_PROFILE_H_
+
+#include <QBDL/exports.hpp>
+
+#include <string>
+
+namespace QBDL {
+
+/** Set the directory where binding profiles are stored.
+ *
+ * With BIND::PROFILE, loaders record the imports that have been lazily
+ * resolved while the binary was loaded, and store them in this directory in
+ * a file named after a hash of the binary. The next time the same binary is
+ * loaded with BIND::PROFILE, these imports are bound eagerly, and the other
+ * ones are left lazy.
+ *
+ * An empty directory (the default) disables profile persistence: BIND::PROFILE
+ * then behaves like BIND::LAZY.
+ */
+QBDL_API void setBindingProfileDirectory(std::string dir);
+
+} // namespace QBDL
+
+#endif
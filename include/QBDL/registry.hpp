@@ -0,0 +1,39 @@
+#ifndef QBDL_REGISTRY_H_
+#define QBDL_REGISTRY_H_
+
+#include <QBDL/exports.hpp>
+
+#include <cstdint>
+
+namespace QBDL {
+class Loader;
+
+/** A binary reserved in the target memory by a loader */
+struct LoadedImage {
+  Loader *loader;
+  /** First address of the image */
+  uint64_t begin;
+  /** Address following the last byte of the image */
+  uint64_t end;
+};
+
+/** Find the image that contains \p address, among the images of all the
+ * live loaders of the process.
+ *
+ * Images are registered once reserved (see ::QBDL::Loader::reserve) and
+ * unregistered when their loader is destroyed. The lookup is a binary
+ * search in an immutable snapshot of the registry: it is lock-free, does
+ * not allocate, and can be called from signal handlers.
+ *
+ * The returned loader may be destroyed concurrently by another thread: it is
+ * up to the caller to ensure that it is still alive before using it.
+ *
+ * @param[in] address Absolute virtual address to look up
+ * @param[out] image The image containing \p address
+ * @returns false if no image contains \p address.
+ */
+QBDL_API bool findLoadedImage(uint64_t address, LoadedImage &image);
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef QBDL_SYMBOL_H_
+#define QBDL_SYMBOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace QBDL {
+
+/** GNU hash of a symbol name, as used by the `DT_GNU_HASH` ELF tables */
+constexpr uint32_t gnu_hash(std::string_view name) {
+  uint32_t hash = 5381;
+  for (char c : name) {
+    hash = hash * 33 + static_cast<uint8_t>(c);
+  }
+  return hash;
+}
+
+/** Name of a symbol along with its hash, for ::QBDL::Loader::get_address.
+ *
+ * Handles are meant to be built at compile time, from literals:
+ *
+ * \code
+ * using namespace QBDL::literals;
+ * static constexpr QBDL::SymbolHandle ENTRY = "entry"_qsym;
+ * auto *entry = loader->get_function<int(const char *)>(ENTRY);
+ * \endcode
+ */
+struct SymbolHandle {
+  constexpr explicit SymbolHandle(std::string_view name)
+      : name(name), hash(gnu_hash(name)) {}
+
+  std::string_view name;
+  uint32_t hash;
+};
+
+namespace literals {
+/** Makes a ::QBDL::SymbolHandle from a string literal */
+constexpr SymbolHandle operator""_qsym(const char *name, size_t len) {
+  return SymbolHandle{std::string_view{name, len}};
+}
+} // namespace literals
+
+} // namespace QBDL
+
+#endif
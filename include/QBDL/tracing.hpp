@@ -0,0 +1,32 @@
+#ifndef QBDL_TRACING_H_
+#define QBDL_TRACING_H_
+
+#include <QBDL/exports.hpp>
+
+#include <string>
+
+namespace QBDL {
+
+/** Start recording a timeline of the loading pipeline.
+ *
+ * Begin and end events are recorded, with the calling thread, for each
+ * loading stage, each batch of writes to the target memory, each batch of
+ * symbol resolutions and each lazily bound symbol. Events recorded before
+ * are discarded.
+ *
+ * When tracing is not started (the default), instrumented code only checks
+ * an atomic flag.
+ */
+QBDL_API void startTracing();
+
+/** Stop recording, and write the recorded events to \p path in the Chrome
+ * trace event format, which can be opened in `chrome://tracing` or
+ * https://ui.perfetto.dev.
+ *
+ * @returns false if \p path cannot be written.
+ */
+QBDL_API bool stopTracing(const std::string &path);
+
+} // namespace QBDL
+
+#endif
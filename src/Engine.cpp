@@ -1,7 +1,10 @@
 #include "intmem.hpp"
+#include "logging.hpp"
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
 
+#include <LIEF/Abstract/Symbol.hpp>
+
 namespace QBDL {
 
 namespace {
@@ -41,6 +44,8 @@ uint64_t read_ptr_impl(TargetMemory &mem, uint64_t addr,
 
 } // namespace
 
+bool TargetMemory::munmap(uint64_t addr, size_t len) { return false; }
+
 void TargetMemory::write_ptr(Arch const &arch, uint64_t addr, uint64_t ptr) {
   archPtrType(arch, [&](auto tag) {
     using T = typename decltype(tag)::type;
@@ -48,6 +53,11 @@ void TargetMemory::write_ptr(Arch const &arch, uint64_t addr, uint64_t ptr) {
   });
 }
 
+void TargetMemory::write_ptr_atomic(Arch const &arch, uint64_t addr,
+                                    uint64_t ptr) {
+  write_ptr(arch, addr, ptr);
+}
+
 uint64_t TargetMemory::read_ptr(Arch const &arch, uint64_t addr) {
   return archPtrType(arch, [&](auto tag) {
     using T = typename decltype(tag)::type;
@@ -55,4 +65,28 @@ uint64_t TargetMemory::read_ptr(Arch const &arch, uint64_t addr) {
   });
 }
 
+uint64_t TargetSystem::ifunc_resolve(Loader &loader, uint64_t resolver) {
+  Logger::err("IFUNC resolver at 0x{:x} can't be called by this engine",
+              resolver);
+  return 0;
+}
+
+uint64_t TargetSystem::symlink_import(Loader &loader,
+                                      ImportView const &import) {
+  if (import.by_ordinal) {
+    Logger::warn("Can't resolve {}!#{:d}: imports by ordinal need an "
+                 "implementation of TargetSystem::symlink_import",
+                 import.library, import.ordinal);
+    return 0;
+  }
+  LIEF::Symbol sym{std::string{import.name}};
+  return symlink(loader, sym);
+}
+
+bool TargetSystem::thread_safe_symlink() { return false; }
+
+bool TargetSystem::executes_on_host() { return false; }
+
+TargetTLS *TargetSystem::tls() { return nullptr; }
+
 } // namespace QBDL
@@ -1,14 +1,285 @@
+#include "export_index.hpp"
+#include "import_thunks.hpp"
+#include "logging.hpp"
+#include "perf_map.hpp"
+#include "probes.hpp"
+#include "registry.hpp"
+#include "symbol_index.hpp"
+#include "tracing.hpp"
+#include <QBDL/Engine.hpp>
 #include <QBDL/Loader.hpp>
 
+#include <map>
+#include <unordered_map>
+
 namespace QBDL {
 
+namespace {
+const char *to_string(Loader::STAGE stage) {
+  switch (stage) {
+  case Loader::STAGE::PLANNED:
+    return "PLANNED";
+  case Loader::STAGE::RESERVED:
+    return "RESERVED";
+  case Loader::STAGE::MAPPED:
+    return "MAPPED";
+  case Loader::STAGE::RELOCATED:
+    return "RELOCATED";
+  case Loader::STAGE::BOUND:
+    return "BOUND";
+  }
+  return "UNKNOWN";
+}
+} // namespace
+
 Loader::Loader() = default;
 Loader::Loader(TargetSystem &engine) : engine_{&engine} {}
-Loader::~Loader() = default;
+Loader::~Loader() {
+  stop_background_binding();
+  if (registered_) {
+    registry_remove(this);
+  }
+}
 
 bool Loader::contains_address(uint64_t ptr) const {
   const uint64_t BA = base_address();
   return (ptr >= BA) && (ptr < (BA + mem_size()));
 }
 
+bool Loader::symbolize(uint64_t address, SymbolizedAddress &result) const {
+  // The index is built from absolute addresses
+  if (stage_ == STAGE::PLANNED) {
+    return false;
+  }
+  std::call_once(symbol_index_once_, [this] {
+    symbol_index_ = std::make_unique<SymbolIndex>(
+        function_symbols(), base_address(), mem_size());
+    QBDL_DEBUG("Symbol index: {} functions", symbol_index_->size());
+  });
+  if (!contains_address(address)) {
+    return false;
+  }
+  uint64_t func_rva = 0;
+  if (!symbol_index_->lookup(address - base_address(), result.name,
+                             func_rva)) {
+    return false;
+  }
+  result.function = base_address() + func_rva;
+  result.offset = address - result.function;
+  return true;
+}
+
+const ExportIndex *Loader::export_index() const {
+  // Exports are listed with their absolute addresses: they are not known
+  // before the memory has been reserved
+  if (stage_ == STAGE::PLANNED) {
+    return nullptr;
+  }
+  std::call_once(export_index_once_, [this] {
+    export_index_ = std::make_unique<ExportIndex>(exported_symbols());
+    QBDL_DEBUG("Export index: {} symbols", export_index_->exports().size());
+  });
+  return export_index_.get();
+}
+
+std::vector<ExportedSymbol> const &Loader::exports() const {
+  static const std::vector<ExportedSymbol> none;
+  const ExportIndex *index = export_index();
+  if (index == nullptr) {
+    Logger::err("Exports are only available once the binary is reserved");
+    return none;
+  }
+  return index->exports();
+}
+
+uint64_t Loader::get_address(SymbolHandle const &sym) const {
+  if (const ExportIndex *index = export_index()) {
+    const ExportedSymbol *exported = index->find(sym.name, sym.hash);
+    if (exported != nullptr) {
+      return exported->address;
+    }
+  }
+  return get_address(std::string{sym.name});
+}
+
+void Loader::get_addresses(std::string_view const *names, uint64_t *addresses,
+                           size_t count) const {
+  const ExportIndex *index = export_index();
+  for (size_t idx = 0; idx < count; ++idx) {
+    const ExportedSymbol *sym =
+        index != nullptr ? index->find(names[idx]) : nullptr;
+    addresses[idx] =
+        sym != nullptr ? sym->address : get_address(std::string{names[idx]});
+  }
+}
+
+bool Loader::load(BIND binding) {
+  QBDL_TRACE_SCOPE("load");
+  QBDL_PROBE2(load_start, this, static_cast<int>(stage_));
+  const bool was_bound = stage_ == STAGE::BOUND;
+  const bool ok = run_stages(binding);
+  QBDL_PROBE2(load_end, this, ok);
+  if (ok && !was_bound && perf_map_enabled()) {
+    perf_map_write(function_symbols(), base_address() + mem_size());
+  }
+  return ok;
+}
+
+bool Loader::run_stages(BIND binding) {
+  switch (stage_) {
+  case STAGE::PLANNED: {
+    QBDL_TRACE_SCOPE("reserve");
+    if (!reserve()) {
+      return false;
+    }
+  }
+    [[fallthrough]];
+  case STAGE::RESERVED: {
+    QBDL_TRACE_SCOPE("map");
+    if (!map()) {
+      return false;
+    }
+  }
+    [[fallthrough]];
+  case STAGE::MAPPED: {
+    QBDL_TRACE_SCOPE("relocate");
+    if (!relocate()) {
+      return false;
+    }
+  }
+    [[fallthrough]];
+  case STAGE::RELOCATED: {
+    QBDL_TRACE_SCOPE("bind");
+    return bind(binding);
+  }
+  case STAGE::BOUND:
+    break;
+  }
+  return true;
+}
+
+std::vector<FunctionSymbol> Loader::function_symbols() const { return {}; }
+
+std::vector<ExportedSymbol> Loader::exported_symbols() const { return {}; }
+
+void Loader::register_image() {
+  if (registered_) {
+    registry_remove(this);
+  }
+  registry_add({this, base_address(), base_address() + mem_size()});
+  registered_ = true;
+}
+
+bool Loader::check_stage(STAGE expected) const {
+  if (stage_ != expected) {
+    Logger::err("Invalid loading stage: expected {}, current stage is {}",
+                to_string(expected), to_string(stage_));
+    return false;
+  }
+  return true;
+}
+
+size_t Loader::rebind(std::string_view symbol, uint64_t address) {
+  // It would match all the imports by ordinal
+  if (symbol.empty()) {
+    Logger::err("Can't rebind an empty symbol name");
+    return 0;
+  }
+  const Arch binarch = arch();
+  size_t count = 0;
+  for (const ImportSlot &slot : import_slots()) {
+    if (slot.symbol != symbol) {
+      continue;
+    }
+    engine_->mem().write_ptr_atomic(binarch, slot.address,
+                                    address + slot.addend);
+    ++count;
+  }
+  QBDL_DEBUG("Rebind {} to 0x{:x}: {} slots", symbol, address, count);
+  return count;
+}
+
+size_t Loader::instrument_imports(bool timestamps) {
+  if (!check_stage(STAGE::BOUND)) {
+    return 0;
+  }
+  if (import_thunks_) {
+    Logger::warn("Imports are already instrumented");
+    return 0;
+  }
+  // The background binder must not write the slots anymore
+  wait_binding();
+
+  const Arch binarch = arch();
+  TargetMemory &mem = engine_->mem();
+  // Slots of the same symbol may have been resolved (or rebound) to
+  // different functions: each target gets its own thunk
+  std::map<std::pair<std::string_view, uint64_t>, size_t> thunk_of;
+  std::vector<uint64_t> targets;
+  std::vector<std::pair<uint64_t, size_t>> patches;
+  for (const ImportSlot &slot : import_slots()) {
+    if (!slot.call_only || slot.addend != 0) {
+      continue;
+    }
+    const uint64_t target = mem.read_ptr(binarch, slot.address);
+    // Not resolved yet, or resolved to the binary itself
+    if (target == 0 || contains_address(target)) {
+      continue;
+    }
+    const auto [it, inserted] =
+        thunk_of.emplace(std::make_pair(slot.symbol, target), targets.size());
+    if (inserted) {
+      targets.push_back(target);
+      instrumented_.push_back({slot.symbol, target, 0, 0});
+    }
+    patches.emplace_back(slot.address, it->second);
+  }
+  if (targets.empty()) {
+    return 0;
+  }
+
+  import_thunks_ = ImportThunks::create(mem, binarch, targets, timestamps);
+  if (!import_thunks_) {
+    instrumented_.clear();
+    return 0;
+  }
+  for (const auto &[slot, thunk] : patches) {
+    mem.write_ptr_atomic(binarch, slot, import_thunks_->address(thunk));
+  }
+  QBDL_DEBUG("Instrumented {} slots of {} imports", patches.size(),
+             targets.size());
+  return patches.size();
+}
+
+std::vector<ImportStats> Loader::import_stats() const {
+  std::vector<ImportStats> stats = instrumented_;
+  for (size_t idx = 0; idx < stats.size(); ++idx) {
+    import_thunks_->read(idx, stats[idx].calls, stats[idx].last_call);
+  }
+  return stats;
+}
+
+void Loader::start_background_binding(std::function<void()> binder) {
+  stop_background_binding();
+  std::lock_guard<std::mutex> lock{binder_mutex_};
+  binder_stop_.store(false, std::memory_order_relaxed);
+  binder_ = std::thread{[binder = std::move(binder)] {
+    QBDL_TRACE_SCOPE("background_bind");
+    binder();
+  }};
+}
+
+void Loader::stop_background_binding() {
+  binder_stop_.store(true, std::memory_order_relaxed);
+  wait_binding();
+}
+
+void Loader::wait_binding() {
+  // The binder never takes the lock, so joining while holding it is fine
+  std::lock_guard<std::mutex> lock{binder_mutex_};
+  if (binder_.joinable()) {
+    binder_.join();
+  }
+}
+
 } // namespace QBDL
@@ -1,6 +1,19 @@
+#include "NativeTLS.hpp"
 #include "logging.hpp"
+#include <QBDL/Loader.hpp>
 #include <QBDL/engines/Native.hpp>
 
+#include <atomic>
+
+#if defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+#endif
+
+#if defined(_WIN32)
+#include <Windows.h>
+#include <string>
+#endif
+
 static_assert(
     sizeof(uintptr_t) <= sizeof(uint64_t),
     "native target with pointer integer type > 64 bits are not supported");
@@ -15,16 +28,88 @@ void TargetMemory::read(void *buf, uint64_t addr, size_t size) {
   memcpy(buf, reinterpret_cast<const void *>(addr), size);
 }
 
+void TargetMemory::write_ptr_atomic(Arch const &binarch, uint64_t addr,
+                                    uint64_t ptr) {
+  if (binarch != arch()) {
+    QBDL::TargetMemory::write_ptr_atomic(binarch, addr, ptr);
+    return;
+  }
+  using atomic_ptr_t = std::atomic<uintptr_t>;
+  static_assert(sizeof(atomic_ptr_t) == sizeof(uintptr_t) &&
+                    atomic_ptr_t::is_always_lock_free,
+                "native pointers must be lock-free atomics");
+  reinterpret_cast<atomic_ptr_t *>(addr)->store(static_cast<uintptr_t>(ptr),
+                                                std::memory_order_release);
+}
+
 bool TargetSystem::supports(LIEF::Binary const &bin) {
   return Arch::from_bin(bin) == arch();
 }
 
+uint64_t TargetSystem::ifunc_resolve(Loader &loader, uint64_t resolver) {
+  if (loader.arch() != arch()) {
+    return QBDL::TargetSystem::ifunc_resolve(loader, resolver);
+  }
+#if defined(__linux__) && defined(__aarch64__)
+  // Same arguments as glibc's and bionic's elf_ifunc_invoke
+  struct ifunc_arg_t {
+    unsigned long size;
+    unsigned long hwcap;
+    unsigned long hwcap2;
+  };
+  static constexpr uint64_t IFUNC_ARG_HWCAP = 1ULL << 62;
+  const ifunc_arg_t arg{sizeof(ifunc_arg_t), getauxval(AT_HWCAP),
+                        getauxval(AT_HWCAP2)};
+  using resolver_t = uint64_t (*)(uint64_t, const ifunc_arg_t *);
+  return reinterpret_cast<resolver_t>(resolver)(arg.hwcap | IFUNC_ARG_HWCAP,
+                                                &arg);
+#else
+  // x86 resolvers query the CPU features themselves
+  using resolver_t = uint64_t (*)();
+  return reinterpret_cast<resolver_t>(resolver)();
+#endif
+}
+
+uint64_t TargetSystem::symlink_import(Loader &loader,
+                                      QBDL::ImportView const &import) {
+#if defined(_WIN32)
+  if (loader.arch() == arch()) {
+    // Imports of a DLL are resolved consecutively: keep the last module.
+    // The buffers also provide the NUL-terminated strings Windows needs.
+    thread_local std::string library;
+    thread_local HMODULE module = nullptr;
+    thread_local std::string name;
+    if (module == nullptr || library != import.library) {
+      library.assign(import.library);
+      module = LoadLibraryA(library.c_str());
+    }
+    if (module != nullptr) {
+      FARPROC proc = nullptr;
+      if (import.by_ordinal) {
+        proc = GetProcAddress(module, MAKEINTRESOURCEA(import.ordinal));
+      } else {
+        name.assign(import.name);
+        proc = GetProcAddress(module, name.c_str());
+      }
+      if (proc != nullptr) {
+        return reinterpret_cast<uintptr_t>(proc);
+      }
+    }
+  }
+#endif
+  return QBDL::TargetSystem::symlink_import(loader, import);
+}
+
 uint64_t TargetSystem::base_address_hint(uint64_t binary_base_address,
                                          uint64_t virtual_size) {
   // Mean a random base address
   return 0;
 }
 
+bool TargetSystem::executes_on_host() { return true; }
+
+QBDL::TargetTLS *TargetSystem::tls() { return tls_handler(); }
+
 QBDL_API std::unique_ptr<QBDL::TargetMemory> memory() {
   QBDL::TargetMemory *Ret = new Native::TargetMemory{};
   return std::unique_ptr<QBDL::TargetMemory>{Ret};
@@ -0,0 +1,655 @@
+#include "NativeTLS.hpp"
+#include "logging.hpp"
+#include <QBDL/engines/Native.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+// Size of the static TLS area shared by the binaries using the initial-exec
+// model. It is kept small because, when QBDL is itself dlopen'ed (e.g. by
+// the Python bindings), this area comes out of the libc's surplus static TLS.
+#ifndef QBDL_STATIC_TLS_SIZE
+#define QBDL_STATIC_TLS_SIZE 512
+#endif
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define QBDL_NATIVE_TLS 1
+
+// TLS descriptor resolver for static blocks: returns the offset stored in the
+// second word of the descriptor and preserves every other register.
+#if defined(__x86_64__)
+asm(".text\n"
+    ".p2align 4\n"
+    ".type qbdl_tlsdesc_static, @function\n"
+    "qbdl_tlsdesc_static:\n"
+    "  movq 8(%rax), %rax\n"
+    "  ret\n"
+    ".size qbdl_tlsdesc_static, .-qbdl_tlsdesc_static\n");
+#else
+asm(".text\n"
+    ".p2align 2\n"
+    ".type qbdl_tlsdesc_static, %function\n"
+    "qbdl_tlsdesc_static:\n"
+    "  ldr x0, [x0, #8]\n"
+    "  ret\n"
+    ".size qbdl_tlsdesc_static, .-qbdl_tlsdesc_static\n");
+#endif
+extern "C" void qbdl_tlsdesc_static();
+
+// Copy of the DTV of the calling thread that the dynamic TLS descriptor
+// resolver can read without calling into C++: the blocks of the modules are
+// found in its entries, every 24 bytes, if its epoch is the current one.
+struct FastDTV {
+  uint64_t epoch;
+  uint64_t size;
+  void *entries;
+};
+
+#if defined(__x86_64__)
+// Size of the XSAVE area of the state components enabled by the OS, or 0 if
+// XSAVE is not enabled
+static uint64_t xsave_area_size() {
+  unsigned eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 || (ecx & bit_OSXSAVE) == 0) {
+    return 0;
+  }
+  __cpuid_count(0xd, 0, eax, ebx, ecx, edx);
+  return ebx;
+}
+#endif
+
+#define QBDL_TLS_HIDDEN __attribute__((visibility("hidden")))
+extern "C" {
+QBDL_TLS_HIDDEN thread_local __attribute__((tls_model("initial-exec")))
+FastDTV qbdl_tls_fast_dtv;
+// Bumped each time a module is removed, so that threads revalidate their DTV
+// before trusting it again.
+QBDL_TLS_HIDDEN std::atomic<uint64_t> qbdl_tls_epoch{1};
+QBDL_TLS_HIDDEN void *qbdl_tls_get_addr(void *ti);
+#if defined(__x86_64__)
+// Size of the area used to save the vector registers in the slow path, and
+// whether it is saved with XSAVE (or FXSAVE)
+QBDL_TLS_HIDDEN uint64_t qbdl_tls_save_size =
+    xsave_area_size() != 0 ? xsave_area_size() : 512;
+QBDL_TLS_HIDDEN uint32_t qbdl_tls_use_xsave = xsave_area_size() != 0;
+#endif
+}
+
+// TLS descriptor resolver for dynamic blocks: the second word of the
+// descriptor points to a TLSIndex. The block is looked up in the fast DTV
+// copy, and otherwise allocated by __tls_get_addr, after every register that
+// it may clobber is saved.
+#if defined(__x86_64__)
+asm(".text\n"
+    ".p2align 4\n"
+    ".type qbdl_tlsdesc_dynamic, @function\n"
+    "qbdl_tlsdesc_dynamic:\n"
+    "  movq 8(%rax), %rax\n"
+    "  pushq %rdi\n"
+    "  pushq %rsi\n"
+    "  movq qbdl_tls_fast_dtv@gottpoff(%rip), %rdi\n"
+    "  movq %fs:(%rdi), %rsi\n"
+    "  cmpq qbdl_tls_epoch(%rip), %rsi\n"
+    "  jne 1f\n"
+    "  movq (%rax), %rsi\n"
+    "  subq $1, %rsi\n"
+    "  cmpq %fs:8(%rdi), %rsi\n"
+    "  jae 1f\n"
+    "  movq %fs:16(%rdi), %rdi\n"
+    "  leaq (%rsi,%rsi,2), %rsi\n"
+    "  movq (%rdi,%rsi,8), %rdi\n"
+    "  testq %rdi, %rdi\n"
+    "  jz 1f\n"
+    "  addq 8(%rax), %rdi\n"
+    "  subq %fs:0, %rdi\n"
+    "  movq %rdi, %rax\n"
+    "  popq %rsi\n"
+    "  popq %rdi\n"
+    "  ret\n"
+    "1:\n"
+    "  pushq %rbp\n"
+    "  movq %rsp, %rbp\n"
+    "  pushq %rdx\n"
+    "  pushq %rcx\n"
+    "  pushq %r8\n"
+    "  pushq %r9\n"
+    "  pushq %r10\n"
+    "  pushq %r11\n"
+    "  movq %rax, %rdi\n"
+    "  subq qbdl_tls_save_size(%rip), %rsp\n"
+    "  andq $-64, %rsp\n"
+    "  cmpl $0, qbdl_tls_use_xsave(%rip)\n"
+    "  je 2f\n"
+    // The XSAVE header must be zeroed for XRSTOR
+    "  movq $0, 512(%rsp)\n"
+    "  movq $0, 520(%rsp)\n"
+    "  movq $0, 528(%rsp)\n"
+    "  movq $0, 536(%rsp)\n"
+    "  movq $0, 544(%rsp)\n"
+    "  movq $0, 552(%rsp)\n"
+    "  movq $0, 560(%rsp)\n"
+    "  movq $0, 568(%rsp)\n"
+    "  movl $-1, %eax\n"
+    "  movl $-1, %edx\n"
+    "  xsave64 (%rsp)\n"
+    "  jmp 3f\n"
+    "2:\n"
+    "  fxsave64 (%rsp)\n"
+    "3:\n"
+    "  call qbdl_tls_get_addr\n"
+    "  movq %rax, %rcx\n"
+    "  cmpl $0, qbdl_tls_use_xsave(%rip)\n"
+    "  je 4f\n"
+    "  movl $-1, %eax\n"
+    "  movl $-1, %edx\n"
+    "  xrstor64 (%rsp)\n"
+    "  jmp 5f\n"
+    "4:\n"
+    "  fxrstor64 (%rsp)\n"
+    "5:\n"
+    "  movq %rcx, %rax\n"
+    "  subq %fs:0, %rax\n"
+    "  leaq -48(%rbp), %rsp\n"
+    "  popq %r11\n"
+    "  popq %r10\n"
+    "  popq %r9\n"
+    "  popq %r8\n"
+    "  popq %rcx\n"
+    "  popq %rdx\n"
+    "  popq %rbp\n"
+    "  popq %rsi\n"
+    "  popq %rdi\n"
+    "  ret\n"
+    ".size qbdl_tlsdesc_dynamic, .-qbdl_tlsdesc_dynamic\n");
+#else
+asm(".text\n"
+    ".p2align 2\n"
+    ".type qbdl_tlsdesc_dynamic, %function\n"
+    "qbdl_tlsdesc_dynamic:\n"
+    "  ldr x0, [x0, #8]\n"
+    "  stp x1, x2, [sp, #-32]!\n"
+    "  stp x3, x4, [sp, #16]\n"
+    "  mrs x4, tpidr_el0\n"
+    "  adrp x1, :gottprel:qbdl_tls_fast_dtv\n"
+    "  ldr x1, [x1, #:gottprel_lo12:qbdl_tls_fast_dtv]\n"
+    "  add x1, x1, x4\n"
+    "  adrp x3, qbdl_tls_epoch\n"
+    "  add x3, x3, :lo12:qbdl_tls_epoch\n"
+    "  ldar x3, [x3]\n"
+    "  ldr x2, [x1]\n"
+    "  cmp x2, x3\n"
+    "  b.ne 1f\n"
+    "  ldr x2, [x0]\n"
+    "  sub x2, x2, #1\n"
+    "  ldr x3, [x1, #8]\n"
+    "  cmp x2, x3\n"
+    "  b.hs 1f\n"
+    "  ldr x3, [x1, #16]\n"
+    "  add x2, x2, x2, lsl #1\n"
+    "  ldr x3, [x3, x2, lsl #3]\n"
+    "  cbz x3, 1f\n"
+    "  ldr x2, [x0, #8]\n"
+    "  add x3, x3, x2\n"
+    "  sub x0, x3, x4\n"
+    "  ldp x3, x4, [sp, #16]\n"
+    "  ldp x1, x2, [sp], #32\n"
+    "  ret\n"
+    "1:\n"
+    "  stp x29, x30, [sp, #-16]!\n"
+    "  mov x29, sp\n"
+    "  sub sp, sp, #624\n"
+    "  stp x5, x6, [sp, #0]\n"
+    "  stp x7, x8, [sp, #16]\n"
+    "  stp x9, x10, [sp, #32]\n"
+    "  stp x11, x12, [sp, #48]\n"
+    "  stp x13, x14, [sp, #64]\n"
+    "  stp x15, x16, [sp, #80]\n"
+    "  stp x17, x18, [sp, #96]\n"
+    "  stp q0, q1, [sp, #112]\n"
+    "  stp q2, q3, [sp, #144]\n"
+    "  stp q4, q5, [sp, #176]\n"
+    "  stp q6, q7, [sp, #208]\n"
+    "  stp q8, q9, [sp, #240]\n"
+    "  stp q10, q11, [sp, #272]\n"
+    "  stp q12, q13, [sp, #304]\n"
+    "  stp q14, q15, [sp, #336]\n"
+    "  stp q16, q17, [sp, #368]\n"
+    "  stp q18, q19, [sp, #400]\n"
+    "  stp q20, q21, [sp, #432]\n"
+    "  stp q22, q23, [sp, #464]\n"
+    "  stp q24, q25, [sp, #496]\n"
+    "  stp q26, q27, [sp, #528]\n"
+    "  stp q28, q29, [sp, #560]\n"
+    "  stp q30, q31, [sp, #592]\n"
+    "  bl qbdl_tls_get_addr\n"
+    "  mrs x1, tpidr_el0\n"
+    "  sub x0, x0, x1\n"
+    "  ldp x5, x6, [sp, #0]\n"
+    "  ldp x7, x8, [sp, #16]\n"
+    "  ldp x9, x10, [sp, #32]\n"
+    "  ldp x11, x12, [sp, #48]\n"
+    "  ldp x13, x14, [sp, #64]\n"
+    "  ldp x15, x16, [sp, #80]\n"
+    "  ldp x17, x18, [sp, #96]\n"
+    "  ldp q0, q1, [sp, #112]\n"
+    "  ldp q2, q3, [sp, #144]\n"
+    "  ldp q4, q5, [sp, #176]\n"
+    "  ldp q6, q7, [sp, #208]\n"
+    "  ldp q8, q9, [sp, #240]\n"
+    "  ldp q10, q11, [sp, #272]\n"
+    "  ldp q12, q13, [sp, #304]\n"
+    "  ldp q14, q15, [sp, #336]\n"
+    "  ldp q16, q17, [sp, #368]\n"
+    "  ldp q18, q19, [sp, #400]\n"
+    "  ldp q20, q21, [sp, #432]\n"
+    "  ldp q22, q23, [sp, #464]\n"
+    "  ldp q24, q25, [sp, #496]\n"
+    "  ldp q26, q27, [sp, #528]\n"
+    "  ldp q28, q29, [sp, #560]\n"
+    "  ldp q30, q31, [sp, #592]\n"
+    "  mov sp, x29\n"
+    "  ldp x29, x30, [sp], #16\n"
+    "  ldp x3, x4, [sp, #16]\n"
+    "  ldp x1, x2, [sp], #32\n"
+    "  ret\n"
+    ".size qbdl_tlsdesc_dynamic, .-qbdl_tlsdesc_dynamic\n");
+#endif
+extern "C" void qbdl_tlsdesc_dynamic();
+#endif
+
+namespace QBDL::Engines::Native {
+
+#if QBDL_NATIVE_TLS
+namespace {
+
+static constexpr size_t STATIC_TLS_ALIGN = 64;
+
+// The initial-exec model guarantees that this area is at the same offset from
+// the thread pointer in every thread.
+alignas(STATIC_TLS_ALIGN) thread_local
+    __attribute__((tls_model("initial-exec"))) uint8_t
+        static_tls[QBDL_STATIC_TLS_SIZE];
+
+inline uintptr_t thread_pointer() {
+  uintptr_t tp;
+#if defined(__x86_64__)
+  asm("movq %%fs:0, %0" : "=r"(tp));
+#else
+  asm("mrs %0, tpidr_el0" : "=r"(tp));
+#endif
+  return tp;
+}
+
+inline size_t align_up(size_t value, size_t align) {
+  return (value + align - 1) & ~(align - 1);
+}
+
+// Argument of __tls_get_addr, as written by the DTPMOD64/DTPOFF64 relocations
+struct TLSIndex {
+  uint64_t module;
+  uint64_t offset;
+};
+
+// Dynamic thread vector: TLS blocks of the calling thread, indexed by
+// module ID - 1.
+struct DTV {
+  struct Entry {
+    uint8_t *block = nullptr;
+    uint64_t gen = 0;
+    bool owned = false;
+  };
+
+  ~DTV() {
+    qbdl_tls_fast_dtv = FastDTV{};
+    for (Entry &entry : entries) {
+      release(entry);
+    }
+  }
+
+  static void release(Entry &entry) {
+    if (entry.owned) {
+      std::free(entry.block);
+    }
+    entry = Entry{};
+  }
+
+  uint64_t epoch = 0;
+  std::vector<Entry> entries;
+};
+
+static_assert(sizeof(DTV::Entry) == 24 && offsetof(DTV::Entry, block) == 0,
+              "DTV entries are read by qbdl_tlsdesc_dynamic");
+
+thread_local DTV dtv;
+
+// Publishes the DTV of the calling thread to qbdl_tlsdesc_dynamic
+void sync_fast_dtv() {
+  qbdl_tls_fast_dtv.size = dtv.entries.size();
+  qbdl_tls_fast_dtv.entries = dtv.entries.data();
+  qbdl_tls_fast_dtv.epoch = dtv.epoch;
+}
+
+class TLSHandler final : public QBDL::TargetTLS {
+public:
+  uint64_t add_module(uint64_t image, uint64_t image_size, uint64_t mem_size,
+                      uint64_t align) override;
+  void activate_module(uint64_t module) override;
+  void remove_module(uint64_t module) override;
+  bool static_offset(uint64_t module, int64_t &offset) override;
+  uint64_t get_addr_function() override;
+  uint64_t tlsdesc_static_function() override;
+  uint64_t tlsdesc_dynamic_function() override;
+  uint64_t tlsdesc_argument(uint64_t module, uint64_t offset) override;
+
+  // Slow path of __tls_get_addr
+  uint8_t *block(uint64_t module);
+  void init_thread();
+
+private:
+  struct Module {
+    const uint8_t *image = nullptr;
+    size_t image_size = 0;
+    size_t mem_size = 0;
+    size_t align = 1;
+    // Incremented each time the module is removed, as IDs are reused
+    uint64_t gen = 0;
+    int64_t static_offset = 0;
+    // Range of static_tls used by the module, if it is static
+    size_t static_start = 0;
+    // Arguments of the dynamic TLS descriptors of the module
+    std::vector<std::unique_ptr<TLSIndex>> tlsdesc_args;
+    bool is_static = false;
+    bool used = false;
+    bool active = false;
+  };
+
+  void revalidate();
+  uint8_t *instantiate(uint64_t module);
+  bool reserve_static(Module &mod);
+  void release_static(Module &mod);
+
+  std::mutex mutex_;
+  std::vector<Module> modules_;
+  // Free ranges of static_tls, as sorted and disjoint [start, end) pairs
+  std::vector<std::pair<size_t, size_t>> static_free_{
+      {0, QBDL_STATIC_TLS_SIZE}};
+};
+
+TLSHandler &handler() {
+  static TLSHandler instance;
+  return instance;
+}
+
+#if defined(__x86_64__)
+// Some compilers emit __tls_get_addr calls with a misaligned stack
+__attribute__((force_align_arg_pointer))
+#endif
+void *tls_get_addr(TLSIndex *ti) {
+  if (dtv.epoch == qbdl_tls_epoch.load(std::memory_order_acquire) &&
+      ti->module - 1 < dtv.entries.size()) {
+    uint8_t *block = dtv.entries[ti->module - 1].block;
+    if (block != nullptr) {
+      return block + ti->offset;
+    }
+  }
+  uint8_t *block = handler().block(ti->module);
+  return block == nullptr ? nullptr : block + ti->offset;
+}
+
+uint64_t TLSHandler::add_module(uint64_t image, uint64_t image_size,
+                                uint64_t mem_size, uint64_t align) {
+  if (align == 0) {
+    align = 1;
+  }
+  if ((align & (align - 1)) != 0 || image_size > mem_size) {
+    Logger::err("Invalid TLS segment (align: {}, file size: {}, size: {})",
+                align, image_size, mem_size);
+    return 0;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(std::begin(modules_), std::end(modules_),
+                         [](const Module &mod) { return !mod.used; });
+  if (it == std::end(modules_)) {
+    it = modules_.emplace(std::end(modules_));
+  }
+  Module &mod = *it;
+  mod.image = reinterpret_cast<const uint8_t *>(image);
+  mod.image_size = image_size;
+  mod.mem_size = mem_size;
+  mod.align = align;
+  mod.static_offset = 0;
+  mod.tlsdesc_args.clear();
+  mod.is_static = false;
+  mod.used = true;
+  mod.active = false;
+  const uint64_t module = std::distance(std::begin(modules_), it) + 1;
+  QBDL_DEBUG("TLS module {}: {} bytes, aligned on {}", module, mem_size, align);
+  return module;
+}
+
+void TLSHandler::activate_module(uint64_t module) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (module == 0 || module > modules_.size() || !modules_[module - 1].used) {
+    return;
+  }
+  modules_[module - 1].active = true;
+  // The loading thread may run initial-exec code right away
+  revalidate();
+  instantiate(module);
+}
+
+void TLSHandler::remove_module(uint64_t module) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (module == 0 || module > modules_.size()) {
+    return;
+  }
+  Module &mod = modules_[module - 1];
+  if (mod.is_static) {
+    release_static(mod);
+  }
+  mod.tlsdesc_args.clear();
+  mod.used = false;
+  mod.active = false;
+  ++mod.gen;
+  qbdl_tls_epoch.fetch_add(1, std::memory_order_release);
+  if (module <= dtv.entries.size()) {
+    DTV::release(dtv.entries[module - 1]);
+  }
+}
+
+bool TLSHandler::static_offset(uint64_t module, int64_t &offset) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (module == 0 || module > modules_.size() || !modules_[module - 1].used) {
+    return false;
+  }
+  Module &mod = modules_[module - 1];
+  if (!mod.is_static) {
+    if (mod.align > STATIC_TLS_ALIGN) {
+      Logger::err("TLS module {} is too aligned for static TLS ({})", module,
+                  mod.align);
+      return false;
+    }
+    if (!reserve_static(mod)) {
+      Logger::err("Static TLS exhausted: module {} needs {} bytes "
+                  "(see QBDL_STATIC_TLS_SIZE)",
+                  module, mod.mem_size);
+      return false;
+    }
+  }
+  offset = mod.static_offset;
+  return true;
+}
+
+uint64_t TLSHandler::get_addr_function() {
+  return reinterpret_cast<uintptr_t>(&tls_get_addr);
+}
+
+uint64_t TLSHandler::tlsdesc_static_function() {
+  return reinterpret_cast<uintptr_t>(&qbdl_tlsdesc_static);
+}
+
+uint64_t TLSHandler::tlsdesc_dynamic_function() {
+  return reinterpret_cast<uintptr_t>(&qbdl_tlsdesc_dynamic);
+}
+
+uint64_t TLSHandler::tlsdesc_argument(uint64_t module, uint64_t offset) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (module == 0 || module > modules_.size() || !modules_[module - 1].used) {
+    return 0;
+  }
+  auto &args = modules_[module - 1].tlsdesc_args;
+  args.push_back(std::make_unique<TLSIndex>(TLSIndex{module, offset}));
+  return reinterpret_cast<uintptr_t>(args.back().get());
+}
+
+uint8_t *TLSHandler::block(uint64_t module) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  revalidate();
+  if (module == 0 || module > modules_.size() ||
+      !modules_[module - 1].active) {
+    Logger::err("Access to invalid TLS module {}", module);
+    return nullptr;
+  }
+  return instantiate(module);
+}
+
+void TLSHandler::init_thread() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  revalidate();
+  for (size_t idx = 0; idx < modules_.size(); ++idx) {
+    if (modules_[idx].active && modules_[idx].is_static) {
+      instantiate(idx + 1);
+    }
+  }
+}
+
+// Takes the first free range of static_tls that fits \p mod.
+// mutex_ must be held.
+bool TLSHandler::reserve_static(Module &mod) {
+  for (auto it = std::begin(static_free_); it != std::end(static_free_);
+       ++it) {
+    const auto [begin, end] = *it;
+    const size_t start = align_up(begin, mod.align);
+    if (start > end || end - start < mod.mem_size) {
+      continue;
+    }
+    // Split the range around the block
+    const size_t stop = start + mod.mem_size;
+    it = static_free_.erase(it);
+    if (stop != end) {
+      it = static_free_.insert(it, {stop, end});
+    }
+    if (begin != start) {
+      static_free_.insert(it, {begin, start});
+    }
+    mod.static_start = start;
+    mod.static_offset = static_cast<int64_t>(
+        reinterpret_cast<uintptr_t>(&static_tls[start]) - thread_pointer());
+    mod.is_static = true;
+    return true;
+  }
+  return false;
+}
+
+// Gives the range of \p mod back to the free list, merging it with its
+// neighbors. mutex_ must be held.
+void TLSHandler::release_static(Module &mod) {
+  size_t begin = mod.static_start;
+  size_t end = begin + mod.mem_size;
+  mod.is_static = false;
+  if (begin == end) {
+    return;
+  }
+  auto it = std::lower_bound(std::begin(static_free_), std::end(static_free_),
+                             std::make_pair(begin, end));
+  if (it != std::end(static_free_) && it->first == end) {
+    end = it->second;
+    it = static_free_.erase(it);
+  }
+  if (it != std::begin(static_free_) && std::prev(it)->second == begin) {
+    std::prev(it)->second = end;
+    return;
+  }
+  static_free_.insert(it, {begin, end});
+}
+
+// Frees the blocks of the modules removed since the last call.
+// mutex_ must be held.
+void TLSHandler::revalidate() {
+  const uint64_t epoch = qbdl_tls_epoch.load(std::memory_order_acquire);
+  if (dtv.epoch == epoch) {
+    return;
+  }
+  for (size_t idx = 0; idx < dtv.entries.size(); ++idx) {
+    DTV::Entry &entry = dtv.entries[idx];
+    if (entry.block != nullptr && modules_[idx].gen != entry.gen) {
+      DTV::release(entry);
+    }
+  }
+  dtv.epoch = epoch;
+  sync_fast_dtv();
+}
+
+// Returns the block of the calling thread, allocating and initializing it
+// if needed. mutex_ must be held.
+uint8_t *TLSHandler::instantiate(uint64_t module) {
+  const Module &mod = modules_[module - 1];
+  if (dtv.entries.size() < module) {
+    dtv.entries.resize(module);
+    sync_fast_dtv();
+  }
+  DTV::Entry &entry = dtv.entries[module - 1];
+  if (entry.block != nullptr) {
+    return entry.block;
+  }
+
+  uint8_t *block;
+  if (mod.is_static) {
+    block = reinterpret_cast<uint8_t *>(thread_pointer() + mod.static_offset);
+  } else {
+    const size_t align = std::max(mod.align, sizeof(void *));
+    const size_t size = align_up(std::max<size_t>(mod.mem_size, 1), align);
+    block = static_cast<uint8_t *>(std::aligned_alloc(align, size));
+    if (block == nullptr) {
+      Logger::err("Unable to allocate a TLS block of {} bytes", size);
+      return nullptr;
+    }
+  }
+  memcpy(block, mod.image, mod.image_size);
+  memset(block + mod.image_size, 0, mod.mem_size - mod.image_size);
+  entry.block = block;
+  entry.gen = mod.gen;
+  entry.owned = !mod.is_static;
+  return block;
+}
+
+} // namespace
+
+extern "C" QBDL_TLS_HIDDEN void *qbdl_tls_get_addr(void *ti) {
+  return tls_get_addr(static_cast<TLSIndex *>(ti));
+}
+
+QBDL::TargetTLS *tls_handler() { return &handler(); }
+
+QBDL_API void init_thread_tls() { handler().init_thread(); }
+
+#else
+
+QBDL::TargetTLS *tls_handler() { return nullptr; }
+
+QBDL_API void init_thread_tls() {}
+
+#endif
+
+} // namespace QBDL::Engines::Native
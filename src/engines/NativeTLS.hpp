@@ -0,0 +1,15 @@
+#ifndef QBDL_ENGINES_NATIVE_TLS_H_
+#define QBDL_ENGINES_NATIVE_TLS_H_
+
+#include <QBDL/Engine.hpp>
+
+namespace QBDL::Engines::Native {
+
+/** Returns the process-wide TLS handler used by the native engine, or
+ * nullptr if TLS is not supported on this host.
+ */
+QBDL::TargetTLS *tls_handler();
+
+} // namespace QBDL::Engines::Native
+
+#endif
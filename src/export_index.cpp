@@ -0,0 +1,43 @@
+#include "export_index.hpp"
+
+#include <utility>
+
+namespace QBDL {
+
+ExportIndex::ExportIndex(std::vector<ExportedSymbol> exports)
+    : exports_(std::move(exports)) {
+  // At most half full, so that probe sequences stay short
+  size_t capacity = 16;
+  while (capacity < 2 * exports_.size()) {
+    capacity *= 2;
+  }
+  buckets_.assign(capacity, {0, 0});
+  mask_ = capacity - 1;
+
+  for (size_t idx = 0; idx < exports_.size(); ++idx) {
+    const std::string_view name = exports_[idx].name;
+    const uint32_t hash = gnu_hash(name);
+    if (find(name, hash) != nullptr) {
+      continue;
+    }
+    size_t pos = hash & mask_;
+    while (buckets_[pos].index != 0) {
+      pos = (pos + 1) & mask_;
+    }
+    buckets_[pos] = {hash, static_cast<uint32_t>(idx + 1)};
+  }
+}
+
+const ExportedSymbol *ExportIndex::find(std::string_view name,
+                                        uint32_t hash) const {
+  for (size_t pos = hash & mask_; buckets_[pos].index != 0;
+       pos = (pos + 1) & mask_) {
+    const Bucket &bucket = buckets_[pos];
+    if (bucket.hash == hash && exports_[bucket.index - 1].name == name) {
+      return &exports_[bucket.index - 1];
+    }
+  }
+  return nullptr;
+}
+
+} // namespace QBDL
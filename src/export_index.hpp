@@ -0,0 +1,47 @@
+#ifndef QBDL_EXPORT_INDEX_H_
+#define QBDL_EXPORT_INDEX_H_
+
+#include <QBDL/Loader.hpp>
+#include <QBDL/symbol.hpp>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace QBDL {
+
+/** Exported symbols of a loaded binary, indexed by name.
+ *
+ * The index is an open-addressing hash table of (GNU hash, position)
+ * pairs, so that a lookup only compares names whose hashes are equal.
+ */
+class ExportIndex {
+public:
+  explicit ExportIndex(std::vector<ExportedSymbol> exports);
+
+  std::vector<ExportedSymbol> const &exports() const { return exports_; }
+
+  /** Finds the first export named \p name, whose GNU hash is \p hash.
+   *
+   * @returns nullptr if \p name is not exported
+   */
+  const ExportedSymbol *find(std::string_view name, uint32_t hash) const;
+
+  const ExportedSymbol *find(std::string_view name) const {
+    return find(name, gnu_hash(name));
+  }
+
+private:
+  struct Bucket {
+    uint32_t hash;
+    uint32_t index; // Position in exports_ plus one, 0 if empty
+  };
+
+  std::vector<ExportedSymbol> exports_;
+  std::vector<Bucket> buckets_;
+  size_t mask_{0};
+};
+
+} // namespace QBDL
+
+#endif
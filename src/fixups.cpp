@@ -0,0 +1,71 @@
+#include "fixups.hpp"
+#include "intmem.hpp"
+#include "probes.hpp"
+#include "tracing.hpp"
+#include <QBDL/Engine.hpp>
+#include <QBDL/utils.hpp>
+
+#include <algorithm>
+
+namespace QBDL {
+
+namespace {
+template <class T>
+void apply(uint8_t *ptr, uint64_t value, FixupBatch::KIND kind,
+           bool little_endian) {
+  T data = little_endian ? intmem::loadu_le<T>(ptr) : intmem::loadu_be<T>(ptr);
+  if (kind == FixupBatch::KIND::ADD) {
+    data += static_cast<T>(value);
+  } else {
+    data = static_cast<T>(value);
+  }
+  if (little_endian) {
+    intmem::storeu_le<T>(ptr, data);
+  } else {
+    intmem::storeu_be<T>(ptr, data);
+  }
+}
+} // namespace
+
+FixupBatch::FixupBatch(TargetMemory &mem, Arch const &arch)
+    : mem_(mem), little_endian_(arch.endianness ==
+                                LIEF::ENDIANNESS::ENDIAN_LITTLE),
+      ptr_width_(arch.is64 ? 8 : 4) {}
+
+void FixupBatch::flush() {
+  QBDL_TRACE_SCOPE("fixups", fixups_.size());
+  QBDL_PROBE1(relocation_batch, fixups_.size());
+  // Stable, so that fixups to the same address are applied in order
+  std::stable_sort(std::begin(fixups_), std::end(fixups_),
+                   [](const Fixup &lhs, const Fixup &rhs) {
+                     return lhs.addr < rhs.addr;
+                   });
+
+  auto it = std::begin(fixups_);
+  while (it != std::end(fixups_)) {
+    // Span of the fixups starting in this page
+    const uint64_t begin = it->addr;
+    const uint64_t page = page_start(begin);
+    uint64_t end = begin;
+    auto last = it;
+    for (; last != std::end(fixups_) && page_start(last->addr) == page;
+         ++last) {
+      end = std::max(end, last->addr + last->width);
+    }
+
+    buffer_.resize(end - begin);
+    mem_.read(buffer_.data(), begin, buffer_.size());
+    for (; it != last; ++it) {
+      uint8_t *ptr = buffer_.data() + (it->addr - begin);
+      if (it->width == 8) {
+        apply<uint64_t>(ptr, it->value, it->kind, little_endian_);
+      } else {
+        apply<uint32_t>(ptr, it->value, it->kind, little_endian_);
+      }
+    }
+    mem_.write(begin, buffer_.data(), buffer_.size());
+  }
+  fixups_.clear();
+}
+
+} // namespace QBDL
@@ -0,0 +1,66 @@
+#ifndef QBDL_FIXUPS_H_
+#define QBDL_FIXUPS_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace QBDL {
+
+class TargetMemory;
+
+/** Batches integer writes (pointers, relocated words) into a target memory.
+ *
+ * Fixups are queued and applied by ::QBDL::FixupBatch::flush: they are sorted
+ * by address and, for each page, the span covering its fixups is read once,
+ * patched in a local buffer, and written back once.
+ *
+ * The read-modify-write of whole spans makes it unsuitable for memory that
+ * is accessed concurrently: use ::QBDL::TargetMemory::write_ptr_atomic there.
+ */
+class FixupBatch {
+public:
+  enum class KIND : uint8_t {
+    SET, ///< Overwrite the value
+    ADD, ///< Add to the value already in memory
+  };
+
+  FixupBatch(TargetMemory &mem, Arch const &arch);
+
+  /** Queues a fixup of \p width bytes (4 or 8) at \p addr. */
+  void push(uint64_t addr, uint64_t value, uint8_t width, KIND kind) {
+    fixups_.push_back({addr, value, width, kind});
+  }
+
+  /** Queues a pointer write, using the pointer size of the architecture. */
+  void set_ptr(uint64_t addr, uint64_t value) {
+    push(addr, value, ptr_width_, KIND::SET);
+  }
+
+  size_t size() const { return fixups_.size(); }
+
+  /** Applies the queued fixups, in order for a given address, and clears the
+   * queue.
+   */
+  void flush();
+
+private:
+  struct Fixup {
+    uint64_t addr;
+    uint64_t value;
+    uint8_t width;
+    KIND kind;
+  };
+
+  TargetMemory &mem_;
+  const bool little_endian_;
+  const uint8_t ptr_width_;
+  std::vector<Fixup> fixups_;
+  std::vector<uint8_t> buffer_;
+};
+
+} // namespace QBDL
+
+#endif
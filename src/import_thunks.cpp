@@ -0,0 +1,121 @@
+#include "import_thunks.hpp"
+#include "intmem.hpp"
+#include "logging.hpp"
+#include <QBDL/Engine.hpp>
+#include <QBDL/utils.hpp>
+
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+
+namespace QBDL {
+
+namespace {
+constexpr size_t CALLS = 0;
+constexpr size_t LAST_CALL = 8;
+constexpr size_t TARGET = 16;
+
+/** Stores the 32-bit displacement from the end of an instruction to \p to */
+void put_rel32(uint8_t *insn_end, uint64_t from, uint64_t to) {
+  intmem::storeu_le<uint32_t>(insn_end - 4, static_cast<uint32_t>(to - from));
+}
+
+size_t emit_x86_64(uint8_t *out, uint64_t pc, uint64_t data, bool timestamps) {
+  uint8_t *ptr = out;
+  auto emit = [&](std::initializer_list<uint8_t> bytes) {
+    for (uint8_t byte : bytes) {
+      *ptr++ = byte;
+    }
+  };
+  if (timestamps) {
+    emit({0x50});                         // push %rax
+    emit({0x52});                         // push %rdx
+    emit({0x0f, 0x31});                   // rdtsc
+    emit({0x48, 0xc1, 0xe2, 0x20});       // shl $32, %rdx
+    emit({0x48, 0x09, 0xd0});             // or %rdx, %rax
+    emit({0x48, 0x89, 0x05, 0, 0, 0, 0}); // mov %rax, LAST_CALL(%rip)
+    put_rel32(ptr, pc + (ptr - out), data + LAST_CALL);
+    emit({0x5a}); // pop %rdx
+    emit({0x58}); // pop %rax
+  }
+  emit({0xf0, 0x48, 0xff, 0x05, 0, 0, 0, 0}); // lock incq CALLS(%rip)
+  put_rel32(ptr, pc + (ptr - out), data + CALLS);
+  emit({0xff, 0x25, 0, 0, 0, 0}); // jmp *TARGET(%rip)
+  put_rel32(ptr, pc + (ptr - out), data + TARGET);
+  return ptr - out;
+}
+
+size_t emit_aarch64(uint8_t *out, uint64_t data) {
+  static constexpr uint32_t CODE[] = {
+      0xf81f0fe0, // str x0, [sp, #-16]!
+      0x58000130, // ldr x16, data
+      0xc85f7e11, // 1: ldxr x17, [x16]
+      0x91000631, // add x17, x17, #1
+      0xc8007e11, // stxr w0, x17, [x16]
+      0x35ffffa0, // cbnz w0, 1b
+      0xf84107e0, // ldr x0, [sp], #16
+      0xf9400a10, // ldr x16, [x16, #TARGET]
+      0xd61f0200, // br x16
+      0xd503201f, // nop
+  };
+  for (size_t idx = 0; idx < std::size(CODE); ++idx) {
+    intmem::storeu_le<uint32_t>(out + idx * 4, CODE[idx]);
+  }
+  // data: literal loaded by the second instruction
+  intmem::storeu_le<uint64_t>(out + sizeof(CODE), data);
+  return sizeof(CODE) + 8;
+}
+} // namespace
+
+std::unique_ptr<ImportThunks>
+ImportThunks::create(TargetMemory &mem, Arch const &arch,
+                     std::vector<uint64_t> const &targets, bool timestamps) {
+  const bool x86_64 = arch.arch == LIEF::ARCH_X86 && arch.is64;
+  const bool aarch64 = arch.arch == LIEF::ARCH_ARM64;
+  if (!x86_64 && !aarch64) {
+    Logger::warn("Import thunks are only supported on x86-64 and AArch64");
+    return nullptr;
+  }
+  if (timestamps && !x86_64) {
+    Logger::warn("Import call timestamps are only supported on x86-64");
+    timestamps = false;
+  }
+
+  // Code pages, followed by data pages
+  const size_t code_size = page_align(targets.size() * THUNK_SIZE);
+  const size_t data_size = page_align(targets.size() * DATA_SIZE);
+  const uint64_t code = mem.mmap(0, code_size + data_size);
+  if (code == 0) {
+    Logger::err("Unable to allocate the import thunks");
+    return nullptr;
+  }
+  const uint64_t data = code + code_size;
+
+  std::vector<uint8_t> buffer(code_size + data_size, 0);
+  for (size_t idx = 0; idx < targets.size(); ++idx) {
+    uint8_t *thunk = &buffer[idx * THUNK_SIZE];
+    const uint64_t thunk_data = data + idx * DATA_SIZE;
+    if (x86_64) {
+      const size_t size = emit_x86_64(thunk, code + idx * THUNK_SIZE,
+                                      thunk_data, timestamps);
+      std::memset(thunk + size, 0xcc, THUNK_SIZE - size); // int3
+    } else {
+      emit_aarch64(thunk, thunk_data);
+    }
+    intmem::storeu_le<uint64_t>(&buffer[code_size + idx * DATA_SIZE + TARGET],
+                                targets[idx]);
+  }
+  mem.write(code, buffer.data(), buffer.size());
+  QBDL_DEBUG("{} import thunks at 0x{:x}", targets.size(), code);
+  return std::unique_ptr<ImportThunks>{new ImportThunks{mem, code, data}};
+}
+
+void ImportThunks::read(size_t idx, uint64_t &calls,
+                        uint64_t &last_call) const {
+  uint8_t buf[TARGET];
+  mem_.read(buf, data_ + idx * DATA_SIZE, sizeof(buf));
+  calls = intmem::loadu_le<uint64_t>(buf + CALLS);
+  last_call = intmem::loadu_le<uint64_t>(buf + LAST_CALL);
+}
+
+} // namespace QBDL
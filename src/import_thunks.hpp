@@ -0,0 +1,57 @@
+#ifndef QBDL_IMPORT_THUNKS_H_
+#define QBDL_IMPORT_THUNKS_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace QBDL {
+
+class TargetMemory;
+
+/** Generated code, in the target memory, that counts the calls to imported
+ * functions.
+ *
+ * Each thunk atomically increments its counter, optionally stores the
+ * timestamp counter of the CPU (x86-64 only), and tail-jumps to its target,
+ * so that the arguments and the return address of the call are untouched.
+ * The counters are shared by all the threads.
+ */
+class ImportThunks {
+public:
+  /** Generates one thunk per address of \p targets.
+   *
+   * @returns nullptr if \p arch is not supported (x86-64 and AArch64 are),
+   * or if the memory could not be allocated.
+   */
+  static std::unique_ptr<ImportThunks>
+  create(TargetMemory &mem, Arch const &arch,
+         std::vector<uint64_t> const &targets, bool timestamps);
+
+  /** Absolute virtual address of the thunk \p idx */
+  uint64_t address(size_t idx) const { return code_ + idx * THUNK_SIZE; }
+
+  /** Reads the number of calls made through the thunk \p idx, and the
+   * timestamp of the last one (0 if timestamps are not recorded).
+   */
+  void read(size_t idx, uint64_t &calls, uint64_t &last_call) const;
+
+private:
+  // Data of a thunk: call counter, last timestamp, target
+  static constexpr size_t THUNK_SIZE = 48;
+  static constexpr size_t DATA_SIZE = 24;
+
+  ImportThunks(TargetMemory &mem, uint64_t code, uint64_t data)
+      : mem_(mem), code_(code), data_(data) {}
+
+  TargetMemory &mem_;
+  uint64_t code_;
+  uint64_t data_;
+};
+
+} // namespace QBDL
+
+#endif
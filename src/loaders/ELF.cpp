@@ -1,10 +1,19 @@
+#include "fixups.hpp"
+#include "intmem.hpp"
 #include "logging.hpp"
+#include "parallel.hpp"
+#include "probes.hpp"
+#include "profile.hpp"
+#include "tracing.hpp"
+#include "x86_64_decoder.hpp"
 #include <LIEF/ELF.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
 #include <QBDL/loaders/ELF.hpp>
 #include <QBDL/utils.hpp>
 
+#include <algorithm>
+
 using namespace LIEF::ELF;
 
 namespace QBDL::Loaders {
@@ -18,33 +27,21 @@ namespace QBDL::Loaders {
 uintptr_t ELF::dl_resolve(void *loader, uintptr_t hint) {
   static constexpr size_t GOT_RESERVED_ENTRIES_SIZE = 3;
   auto &ldr = *reinterpret_cast<QBDL::Loaders::ELF *>(loader);
-  const Binary &bin = ldr.get_binary();
 
   const ARCH arch = ldr.get_binary().header().machine_type();
   uintptr_t plt_sym_idx = hint;
   if (arch == ARCH::EM_AARCH64) {
-    const uintptr_t got_base = bin.get(DYNAMIC_TAGS::DT_PLTGOT).value();
-    plt_sym_idx =
-        (plt_sym_idx - ldr.base_address_ - got_base) / sizeof(uintptr_t);
+    plt_sym_idx = (plt_sym_idx - ldr.base_address_ - ldr.pltgot_rva_) /
+                  sizeof(uintptr_t);
     // We need to remove the first reserved entries to get the index
     plt_sym_idx -= GOT_RESERVED_ENTRIES_SIZE;
   }
 
-  auto pltgot = ldr.get_binary().pltgot_relocations();
-
-  if (plt_sym_idx >= pltgot.size()) {
+  if (plt_sym_idx >= ldr.plt_relocs_.size()) {
     QBDL::Logger::err("PLT index out of range: {:d}", plt_sym_idx);
     return 0;
   }
-
-  const Relocation &plt_reloc = pltgot[plt_sym_idx];
-  const Symbol &sym = plt_reloc.symbol();
-  const uintptr_t sym_addr = ldr.engine_->symlink(ldr, sym);
-  const uintptr_t addr_target = ldr.get_address(plt_reloc.address());
-
-  QBDL_INFO("Address of {}: 0x{:x}", sym.name(), sym_addr);
-  ldr.engine_->mem().write_ptr(ldr.arch(), addr_target, sym_addr);
-  return sym_addr;
+  return ldr.resolve_slot(plt_sym_idx);
 }
 
 std::unique_ptr<ELF> ELF::from_file(const char *path, TargetSystem &engines,
@@ -64,11 +61,51 @@ std::unique_ptr<ELF> ELF::from_file(const char *path, TargetSystem &engines,
 
 std::unique_ptr<ELF> ELF::from_binary(std::unique_ptr<Binary> bin,
                                       TargetSystem &engines, BIND binding) {
+  std::unique_ptr<ELF> loader = plan(std::move(bin), engines);
+  if (!loader || !loader->load(binding)) {
+    return {};
+  }
+  return loader;
+}
+
+std::unique_ptr<ELF> ELF::plan(std::unique_ptr<Binary> bin,
+                               TargetSystem &engines) {
   if (!engines.supports(*bin)) {
     return {};
   }
   std::unique_ptr<ELF> loader(new ELF{std::move(bin), engines});
-  loader->load(binding);
+  const Binary &binary = loader->get_binary();
+
+  uint64_t virtual_size = binary.virtual_size();
+  virtual_size -= binary.imagebase();
+  virtual_size = page_align(virtual_size);
+  loader->mem_size_ = virtual_size;
+
+  QBDL_DEBUG("Virtual size: 0x{:x}", virtual_size);
+
+  if (binary.has(DYNAMIC_TAGS::DT_PLTGOT)) {
+    loader->pltgot_rva_ =
+        loader->get_rva(binary, binary.get(DYNAMIC_TAGS::DT_PLTGOT).value());
+  }
+
+  const LIEF::ELF::ARCH arch = binary.header().machine_type();
+  switch (arch) {
+  case LIEF::ELF::ARCH::EM_AARCH64: {
+    loader->relocator_ = &ELF::reloc_aarch64;
+    break;
+  }
+
+  case LIEF::ELF::ARCH::EM_X86_64: {
+    loader->relocator_ = &ELF::reloc_x86_64;
+    break;
+  }
+
+  default: {
+    Logger::err("Relocations not supported for the architecture: {}",
+                LIEF::ELF::to_string(arch));
+    return {};
+  }
+  }
   return loader;
 }
 
@@ -80,19 +117,29 @@ ELF::ELF(std::unique_ptr<Binary> bin, TargetSystem &engines)
     if (sym.value() > 0) {
       sym_exp_[sym.name()] = &sym;
     }
+    sym_all_.emplace(sym.name(), &sym);
+  }
+  for (const Symbol &sym : get_binary().static_symbols()) {
+    sym_all_.emplace(sym.name(), &sym);
+  }
+
+  // Index the PLT/GOT relocations once, so that the lazy binding path never
+  // walks LIEF's iterators.
+  for (const Relocation &reloc : get_binary().pltgot_relocations()) {
+    plt_relocs_.push_back(&reloc);
+  }
+  plt_slots_.reset(new std::atomic<uint64_t>[plt_relocs_.size()]);
+  for (size_t i = 0; i < plt_relocs_.size(); ++i) {
+    plt_slots_[i].store(0, std::memory_order_relaxed);
   }
 }
 
 uint64_t ELF::get_address(const std::string &sym) const {
-  const Binary &binary = get_binary();
-  const LIEF::Symbol *symbol = nullptr;
-  if (binary.has_symbol(sym)) {
-    symbol = &binary.get_symbol(sym);
-  }
-  if (symbol == nullptr) {
+  const auto it_sym = sym_all_.find(sym);
+  if (it_sym == std::end(sym_all_)) {
     return 0;
   }
-  return base_address_ + get_rva(binary, symbol->value());
+  return base_address_ + get_rva(get_binary(), it_sym->second->value());
 }
 
 uint64_t ELF::get_address(uint64_t offset) const {
@@ -104,25 +151,52 @@ uint64_t ELF::entrypoint() const {
   return base_address_ + (binary.entrypoint() - binary.imagebase());
 }
 
-void ELF::load(BIND binding) {
-  Binary &binary = get_binary();
-
-  uint64_t virtual_size = binary.virtual_size();
-  virtual_size -= binary.imagebase();
-  virtual_size = page_align(virtual_size);
-  mem_size_ = virtual_size;
+bool ELF::reserve() {
+  if (!check_stage(STAGE::PLANNED)) {
+    return false;
+  }
+  return reserve_at(
+      engine_->base_address_hint(get_binary().imagebase(), mem_size_));
+}
 
-  Logger::debug("Virtual size: 0x{:x}", virtual_size);
+bool ELF::reserve_near_imports() {
+  if (!check_stage(STAGE::PLANNED)) {
+    return false;
+  }
+  uint64_t target = 0;
+  for (const Relocation *reloc : plt_relocs_) {
+    if (reloc->has_symbol() && resolve(reloc->symbol()) == 0) {
+      target = engine_->symlink(*this, reloc->symbol());
+      break;
+    }
+  }
+  // Leave some room between the binary and the imported library
+  static constexpr uint64_t GAP = 0x100000;
+  uint64_t hint = 0;
+  if (target > mem_size_ + GAP) {
+    hint = page_start(target - mem_size_ - GAP);
+  }
+  return reserve_at(hint);
+}
 
-  const uint64_t base_address_hint =
-      engine_->base_address_hint(binary.imagebase(), virtual_size);
+bool ELF::reserve_at(uint64_t base_address_hint) {
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().mmap(base_address_hint, mem_size_);
   if (base_address == 0) {
     Logger::err("mmap() failed! Abort.");
-    return;
+    return false;
   }
   base_address_ = base_address;
+  register_image();
+  stage_ = STAGE::RESERVED;
+  return true;
+}
+
+bool ELF::map() {
+  if (!check_stage(STAGE::RESERVED)) {
+    return false;
+  }
+  const Binary &binary = get_binary();
 
   // Map segments
   // =======================================================
@@ -132,60 +206,654 @@ void ELF::load(BIND binding) {
     }
     const uint64_t rva = get_rva(binary, segment.virtual_address());
 
-    Logger::debug("Mapping {} - 0x{:x}", to_string(segment.type()), rva);
+    QBDL_DEBUG("Mapping {} - 0x{:x}", to_string(segment.type()), rva);
     const std::vector<uint8_t> &content = segment.content();
     if (content.size() > 0) {
-      engine_->mem().write(base_address + rva, content.data(), content.size());
+      engine_->mem().write(base_address_ + rva, content.data(),
+                           content.size());
     }
+    QBDL_PROBE3(segment_map, this, base_address_ + rva, content.size());
   }
+  stage_ = STAGE::MAPPED;
+  return true;
+}
 
-  using relocation_fcn_t = decltype(&ELF::reloc_x86_64);
-  relocation_fcn_t relocator = nullptr;
-  const LIEF::ELF::ARCH arch = get_binary().header().machine_type();
-  switch (arch) {
-  case LIEF::ELF::ARCH::EM_AARCH64: {
-    relocator = &ELF::reloc_aarch64;
-    break;
+bool ELF::relocate() {
+  if (!check_stage(STAGE::MAPPED)) {
+    return false;
   }
 
-  case LIEF::ELF::ARCH::EM_X86_64: {
-    relocator = &ELF::reloc_x86_64;
-    break;
-  }
+  register_tls();
 
-  default: {
-    Logger::err("Relocations not supported for the architecture: {}",
-                LIEF::ELF::to_string(arch));
-    break;
-  }
+  // Perform relocations
+  // =======================================================
+  size_t count = 0;
+  symbol_relocs_.clear();
+  for (const Relocation &reloc : get_binary().dynamic_relocations()) {
+    // Relocations against symbols are resolved by bind()
+    if (is_import_slot(reloc) || is_copy(reloc)) {
+      symbol_relocs_.push_back(&reloc);
+      continue;
+    }
+    (*this.*relocator_)(reloc);
+    ++count;
   }
+  QBDL_PROBE1(relocation_batch, count);
+  stage_ = STAGE::RELOCATED;
+  return true;
+}
 
-  if (relocator == nullptr) {
-    return;
+bool ELF::bind(BIND binding) {
+  if (!check_stage(STAGE::RELOCATED)) {
+    return false;
   }
 
-  // Perform relocations
-  // =======================================================
-  for (const Relocation &reloc : binary.dynamic_relocations()) {
-    (*this.*relocator)(reloc);
+  // Dynamic relocations against symbols are not lazy: they are resolved
+  // whatever the binding mode, even with BIND::NOT_BIND which only leaves the
+  // PLT slots untouched.
+  {
+    std::vector<const Relocation *> slots;
+    std::vector<const Relocation *> copies;
+    for (const Relocation *reloc : symbol_relocs_) {
+      (is_copy(*reloc) ? copies : slots).push_back(reloc);
+    }
+    bind_slots(slots);
+    for (const Relocation *reloc : copies) {
+      (*this.*relocator_)(*reloc);
+    }
   }
 
-  // Bind symbols
+  // Bind PLT slots
   switch (binding) {
   case BIND::NOW:
-    bind_now(relocator);
+    bind_now(relocator_);
     break;
 
-  case BIND::NOT_BIND:
   case BIND::LAZY:
+    bind_lazy();
+    break;
+
+  case BIND::BACKGROUND:
+    if (bind_lazy()) {
+      // Only the imports are left to the background thread: IFUNC resolvers
+      // of the binary must run on the loading thread
+      start_background_binding([this, imported = bind_local_slots()] {
+        for (size_t idx : imported) {
+          if (background_binding_stopped()) {
+            return;
+          }
+          if (plt_slots_[idx].load(std::memory_order_acquire) != 0) {
+            continue;
+          }
+          const Relocation &reloc = *plt_relocs_[idx];
+          const Symbol &sym = reloc.symbol();
+          const uint64_t sym_addr = engine_->symlink(*this, sym);
+          QBDL_PROBE2(symbol_resolve, sym.name().c_str(), sym_addr);
+          if (sym_addr == 0) {
+            QBDL::Logger::err("Unable to resolve {}", sym.name());
+            continue;
+          }
+          publish_slot(idx, sym_addr + reloc.addend());
+        }
+      });
+    }
+    break;
+
+  case BIND::PROFILE:
+    if (bind_lazy()) {
+      bind_profile();
+    }
+    break;
+
+  case BIND::NOT_BIND:
     break;
   }
+  if (tls_module_ != 0) {
+    engine_->tls()->activate_module(tls_module_);
+  }
+  apply_irelative();
+  stage_ = STAGE::BOUND;
+  return true;
 }
 
 void ELF::bind_now(ELF::relocator_t relocator) {
+  if (!engine_->thread_safe_symlink()) {
+    QBDL_TRACE_SCOPE("symlink");
+    for (const Relocation &reloc : get_binary().pltgot_relocations()) {
+      (*this.*relocator)(reloc);
+    }
+    return;
+  }
+
+  // The import slots are resolved as a batch. The other relocations are
+  // applied in order.
+  std::vector<const Relocation *> slots;
   for (const Relocation &reloc : get_binary().pltgot_relocations()) {
-    (*this.*relocator)(reloc);
+    if (!is_import_slot(reloc)) {
+      (*this.*relocator)(reloc);
+      continue;
+    }
+    slots.push_back(&reloc);
+  }
+  bind_slots(slots);
+}
+
+// Resolves each symbol of the import slots \p relocs once, the imported ones
+// concurrently if the target system allows it, and writes the slots in one
+// batch.
+void ELF::bind_slots(const std::vector<const Relocation *> &relocs) {
+  if (relocs.empty()) {
+    return;
+  }
+  std::vector<size_t> slot_symbols;
+  slot_symbols.reserve(relocs.size());
+  std::vector<const Symbol *> symbols;
+  std::unordered_map<const Symbol *, size_t> index;
+  for (const Relocation *reloc : relocs) {
+    const Symbol *sym = &reloc->symbol();
+    const auto it = index.emplace(sym, symbols.size()).first;
+    if (it->second == symbols.size()) {
+      symbols.push_back(sym);
+    }
+    slot_symbols.push_back(it->second);
+  }
+
+  // IFUNC resolvers of the binary must run on the loading thread
+  std::vector<uint64_t> addresses(symbols.size());
+  std::vector<size_t> imported;
+  for (size_t idx = 0; idx < symbols.size(); ++idx) {
+    addresses[idx] = resolve_local(*symbols[idx]);
+    if (addresses[idx] == 0) {
+      imported.push_back(idx);
+    }
+  }
+  {
+    QBDL_TRACE_SCOPE("symlink", imported.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(imported.size(), concurrent, [&](size_t idx) {
+      const Symbol &sym = *symbols[imported[idx]];
+      addresses[imported[idx]] = engine_->symlink(*this, sym);
+      QBDL_PROBE2(symbol_resolve, sym.name().c_str(), addresses[imported[idx]]);
+    });
+  }
+
+  FixupBatch batch{engine_->mem(), arch()};
+  for (size_t idx = 0; idx < relocs.size(); ++idx) {
+    batch.set_ptr(base_address_ + relocs[idx]->address(),
+                  addresses[slot_symbols[idx]] + relocs[idx]->addend());
+  }
+  batch.flush();
+  QBDL_DEBUG("{} slots bound to {} symbols ({} imported)", relocs.size(),
+             symbols.size(), imported.size());
+}
+
+bool ELF::bind_lazy() {
+#if defined(QBDL_LAZY_BINDING)
+  const Binary &binary = get_binary();
+  if (!binary.has(DYNAMIC_TAGS::DT_PLTGOT)) {
+    return false;
+  }
+  const Arch binarch = arch();
+  const uint64_t ptr_size = binarch.is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  const uint64_t got = base_address_ + pltgot_rva_;
+
+  // GOT[1] and GOT[2] are used by the PLT stubs to jump into the resolver
+  // with the loader object as a parameter.
+  engine_->mem().write_ptr(binarch, got + ptr_size,
+                           reinterpret_cast<uintptr_t>(this));
+  engine_->mem().write_ptr(binarch, got + 2 * ptr_size,
+                           reinterpret_cast<uintptr_t>(&_dl_resolve_internal));
+
+  // Unresolved slots point to the PLT stubs: rebase them.
+  for (const Relocation *reloc : plt_relocs_) {
+    if (!is_jump_slot(*reloc)) {
+      (*this.*relocator_)(*reloc);
+      continue;
+    }
+    const uint64_t addr_target =
+        base_address_ + get_rva(binary, reloc->address());
+    const uint64_t stub = engine_->mem().read_ptr(binarch, addr_target);
+    engine_->mem().write_ptr(binarch, addr_target,
+                             base_address_ + get_rva(binary, stub));
   }
+  return true;
+#else
+  Logger::warn("Lazy binding is not supported on this host, binding now");
+  bind_now(relocator_);
+  return false;
+#endif
+}
+
+uintptr_t ELF::resolve_slot(size_t idx) {
+  // Fast path: the slot has already been resolved by another thread that
+  // went through the PLT before the GOT update was visible.
+  std::atomic<uint64_t> &slot = plt_slots_[idx];
+  uint64_t sym_addr = slot.load(std::memory_order_acquire);
+  if (sym_addr != 0) {
+    return sym_addr;
+  }
+
+  const Relocation &reloc = *plt_relocs_[idx];
+  if (!is_jump_slot(reloc)) {
+    return 0;
+  }
+  const Symbol &sym = reloc.symbol();
+  QBDL_TRACE_SCOPE("lazy_bind", sym.name());
+  sym_addr = resolve_or_symlink(sym);
+  if (sym_addr == 0) {
+    QBDL::Logger::err("Unable to resolve {}", sym.name());
+    return 0;
+  }
+  return publish_slot(idx, sym_addr + reloc.addend());
+}
+
+uintptr_t ELF::publish_slot(size_t idx, uint64_t sym_addr) {
+  // Several threads might resolve the same slot concurrently: only the
+  // first one publishes its result and patches the GOT.
+  std::atomic<uint64_t> &slot = plt_slots_[idx];
+  const Relocation &reloc = *plt_relocs_[idx];
+  const Symbol &sym = reloc.symbol();
+  uint64_t expected = 0;
+  if (!slot.compare_exchange_strong(expected, sym_addr,
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+    return expected;
+  }
+  QBDL_PROBE2(lazy_bind, sym.name().c_str(), sym_addr);
+  if (plt_touch_) {
+    plt_touch_[idx].store(touch_seq_.fetch_add(1) + 1,
+                          std::memory_order_relaxed);
+  }
+  QBDL_DEBUG("Address of {}: 0x{:x}", sym.name(), sym_addr);
+  const uint64_t addr_target =
+      base_address_ + get_rva(get_binary(), reloc.address());
+  engine_->mem().write_ptr_atomic(arch(), addr_target, sym_addr);
+  // The slot might have been rebound while we were patching the GOT
+  const uint64_t current = slot.load(std::memory_order_acquire);
+  if (current != sym_addr) {
+    engine_->mem().write_ptr_atomic(arch(), addr_target, current);
+  }
+  return sym_addr;
+}
+
+// Binds the jump slots of the symbols defined by this binary, and returns the
+// indices of the other (imported) ones.
+std::vector<size_t> ELF::bind_local_slots() {
+  std::vector<size_t> imported;
+  for (size_t idx = 0; idx < plt_relocs_.size(); ++idx) {
+    const Relocation &reloc = *plt_relocs_[idx];
+    if (!is_jump_slot(reloc)) {
+      continue;
+    }
+    const uint64_t sym_addr = resolve_local(reloc.symbol());
+    if (sym_addr == 0) {
+      imported.push_back(idx);
+      continue;
+    }
+    publish_slot(idx, sym_addr + reloc.addend());
+  }
+  return imported;
+}
+
+bool ELF::is_import_slot(const Relocation &reloc) const {
+  if (!reloc.has_symbol() || reloc.symbol().name().empty()) {
+    return false;
+  }
+  if (relocator_ == &ELF::reloc_x86_64) {
+    switch (static_cast<RELOC_x86_64>(reloc.type())) {
+    case RELOC_x86_64::R_X86_64_JUMP_SLOT:
+    case RELOC_x86_64::R_X86_64_GLOB_DAT:
+    case RELOC_x86_64::R_X86_64_64:
+      return true;
+    default:
+      return false;
+    }
+  }
+  switch (static_cast<RELOC_AARCH64>(reloc.type())) {
+  case RELOC_AARCH64::R_AARCH64_JUMP_SLOT:
+  case RELOC_AARCH64::R_AARCH64_GLOB_DAT:
+  case RELOC_AARCH64::R_AARCH64_ABS64:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool ELF::is_copy(const Relocation &reloc) const {
+  if (relocator_ == &ELF::reloc_x86_64) {
+    return static_cast<RELOC_x86_64>(reloc.type()) ==
+           RELOC_x86_64::R_X86_64_COPY;
+  }
+  return static_cast<RELOC_AARCH64>(reloc.type()) ==
+         RELOC_AARCH64::R_AARCH64_COPY;
+}
+
+bool ELF::is_jump_slot(const Relocation &reloc) const {
+  if (relocator_ == &ELF::reloc_x86_64) {
+    return static_cast<RELOC_x86_64>(reloc.type()) ==
+           RELOC_x86_64::R_X86_64_JUMP_SLOT;
+  }
+  return static_cast<RELOC_AARCH64>(reloc.type()) ==
+         RELOC_AARCH64::R_AARCH64_JUMP_SLOT;
+}
+
+void ELF::apply_irelative() {
+  const Arch binarch = arch();
+  for (const Relocation *reloc : irelative_relocs_) {
+    const uint64_t resolver = base_address_ + reloc->addend();
+    const uint64_t impl = engine_->ifunc_resolve(*this, resolver);
+    engine_->mem().write_ptr(binarch, base_address_ + reloc->address(), impl);
+  }
+  irelative_relocs_.clear();
+}
+
+std::vector<ImportSlot> ELF::import_slots() const {
+  const Binary &binary = get_binary();
+  std::vector<ImportSlot> slots;
+  for (const Relocation &reloc : binary.dynamic_relocations()) {
+    if (is_import_slot(reloc)) {
+      slots.push_back({reloc.symbol().name(),
+                       base_address_ + get_rva(binary, reloc.address()),
+                       reloc.addend(), false});
+    }
+  }
+  for (const Relocation *reloc : plt_relocs_) {
+    if (is_import_slot(*reloc)) {
+      slots.push_back({reloc->symbol().name(),
+                       base_address_ + get_rva(binary, reloc->address()),
+                       reloc->addend(), true});
+    }
+  }
+  return slots;
+}
+
+std::vector<FunctionSymbol> ELF::function_symbols() const {
+  const Binary &binary = get_binary();
+  std::vector<FunctionSymbol> functions;
+  auto add = [&](const Symbol &sym) {
+    // SHN_UNDEF: imported
+    if (sym.is_function() && sym.shndx() != 0 && sym.value() != 0) {
+      functions.push_back({sym.name(),
+                           base_address_ + get_rva(binary, sym.value()),
+                           sym.size()});
+    }
+  };
+  for (const Symbol &sym : binary.static_symbols()) {
+    add(sym);
+  }
+  for (const Symbol &sym : binary.dynamic_symbols()) {
+    add(sym);
+  }
+  return functions;
+}
+
+std::vector<ExportedSymbol> ELF::exported_symbols() const {
+  const Binary &binary = get_binary();
+  std::vector<ExportedSymbol> exports;
+  for (const Symbol &sym : binary.dynamic_symbols()) {
+    // The values of TLS symbols are offsets in the TLS block
+    if (!sym.is_exported() || sym.type() == ELF_SYMBOL_TYPES::STT_TLS) {
+      continue;
+    }
+    ExportedSymbol::KIND kind = ExportedSymbol::KIND::UNKNOWN;
+    if (sym.is_function()) {
+      kind = ExportedSymbol::KIND::FUNCTION;
+    } else if (sym.is_variable()) {
+      kind = ExportedSymbol::KIND::DATA;
+    }
+    exports.push_back(
+        {sym.name(), base_address_ + get_rva(binary, sym.value()), kind});
+  }
+  return exports;
+}
+
+size_t ELF::rebind(std::string_view symbol, uint64_t address) {
+  if (symbol.empty()) {
+    return Loader::rebind(symbol, address); // Rejected
+  }
+  // Update the lazy binding state first, so that a pending resolution of
+  // these slots does not overwrite the new address.
+  for (size_t idx = 0; idx < plt_relocs_.size(); ++idx) {
+    const Relocation &reloc = *plt_relocs_[idx];
+    if (reloc.has_symbol() && reloc.symbol().name() == symbol) {
+      plt_slots_[idx].store(address + reloc.addend(),
+                            std::memory_order_release);
+    }
+  }
+  return Loader::rebind(symbol, address);
+}
+
+void ELF::bind_profile() {
+  const std::string path = BindingProfile::path(binary_hash());
+  if (path.empty()) {
+    Logger::warn("No binding profile directory set, binding lazily");
+    return;
+  }
+  profile_ = std::make_unique<BindingProfile>();
+  profile_->load(path);
+
+  plt_touch_.reset(new std::atomic<uint32_t>[plt_relocs_.size()]);
+  for (size_t idx = 0; idx < plt_relocs_.size(); ++idx) {
+    plt_touch_[idx].store(0, std::memory_order_relaxed);
+  }
+  profile_path_ = path;
+
+  // Bind the hot imports in one batch, like bind_now. They are recorded as
+  // touched, so that they are kept in the profile.
+  std::vector<size_t> hot;
+  for (size_t idx = 0; idx < plt_relocs_.size(); ++idx) {
+    const Relocation &reloc = *plt_relocs_[idx];
+    if (is_jump_slot(reloc) && profile_->contains(reloc.symbol().name())) {
+      hot.push_back(idx);
+    }
+  }
+
+  // IFUNC resolvers of the binary must run on the loading thread
+  std::vector<uint64_t> addresses(hot.size());
+  std::vector<size_t> imported;
+  for (size_t idx = 0; idx < hot.size(); ++idx) {
+    addresses[idx] = resolve_local(plt_relocs_[hot[idx]]->symbol());
+    if (addresses[idx] == 0) {
+      imported.push_back(idx);
+    }
+  }
+  {
+    QBDL_TRACE_SCOPE("symlink", imported.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(imported.size(), concurrent, [&](size_t idx) {
+      const Symbol &sym = plt_relocs_[hot[imported[idx]]]->symbol();
+      addresses[imported[idx]] = engine_->symlink(*this, sym);
+      QBDL_PROBE2(symbol_resolve, sym.name().c_str(), addresses[imported[idx]]);
+    });
+  }
+
+  const Binary &binary = get_binary();
+  FixupBatch batch{engine_->mem(), arch()};
+  for (size_t idx = 0; idx < hot.size(); ++idx) {
+    const Relocation &reloc = *plt_relocs_[hot[idx]];
+    if (addresses[idx] == 0) {
+      // Left to the lazy resolver
+      Logger::err("Unable to resolve {}", reloc.symbol().name());
+      continue;
+    }
+    const uint64_t sym_addr = addresses[idx] + reloc.addend();
+    plt_slots_[hot[idx]].store(sym_addr, std::memory_order_release);
+    plt_touch_[hot[idx]].store(touch_seq_.fetch_add(1) + 1,
+                               std::memory_order_relaxed);
+    batch.set_ptr(base_address_ + get_rva(binary, reloc.address()), sym_addr);
+  }
+  batch.flush();
+  QBDL_DEBUG("Binding profile: {} hot imports bound", hot.size());
+}
+
+void ELF::save_profile() {
+  std::vector<std::pair<uint32_t, std::string_view>> touched;
+  for (size_t idx = 0; idx < plt_relocs_.size(); ++idx) {
+    const uint32_t order = plt_touch_[idx].load(std::memory_order_relaxed);
+    if (order != 0) {
+      touched.emplace_back(order, plt_relocs_[idx]->symbol().name());
+    }
+  }
+  std::sort(std::begin(touched), std::end(touched));
+
+  std::vector<std::string_view> names;
+  names.reserve(touched.size());
+  for (const auto &entry : touched) {
+    names.push_back(entry.second);
+  }
+  profile_->record(names);
+  profile_->save(profile_path_);
+}
+
+uint64_t ELF::binary_hash() const {
+  const Binary &binary = get_binary();
+  // Prefer the GNU build ID when there is one
+  for (const Note &note : binary.notes()) {
+    if (note.type() == NOTE_TYPES::NT_GNU_BUILD_ID) {
+      const std::vector<uint8_t> &id = note.description();
+      return fnv1a(id.data(), id.size());
+    }
+  }
+  uint64_t hash = fnv1a(&mem_size_, sizeof(mem_size_));
+  for (const Relocation *reloc : plt_relocs_) {
+    const std::string &name = reloc->symbol().name();
+    hash = fnv1a(name.data(), name.size() + 1, hash);
+  }
+  return hash;
+}
+
+size_t ELF::bypass_plt() {
+  if (!check_stage(STAGE::BOUND)) {
+    return 0;
+  }
+  if (relocator_ != &ELF::reloc_x86_64) {
+    Logger::warn("PLT bypass is only supported for x86-64 binaries");
+    return 0;
+  }
+  const Binary &binary = get_binary();
+  const Arch binarch = arch();
+
+  auto is_plt = [](const Section &section) {
+    return section.name().compare(0, 4, ".plt") == 0;
+  };
+
+  // Resolved target of each PLT stub. A stub is identified by the
+  // `jmp *disp32(%rip)` it contains, which reads a GOT slot: a JUMP_SLOT
+  // one for .plt and .plt.sec, a GLOB_DAT one for .plt.got.
+  std::unordered_map<uint64_t, uint64_t> got_targets;
+  for (const ImportSlot &slot : import_slots()) {
+    got_targets.emplace(slot.address,
+                        engine_->mem().read_ptr(binarch, slot.address));
+  }
+
+  std::unordered_map<uint64_t, uint64_t> stub_targets;
+  std::vector<std::pair<uint64_t, uint64_t>> plt_ranges;
+  for (const Section &section : binary.sections()) {
+    if (!is_plt(section)) {
+      continue;
+    }
+    const uint64_t start =
+        base_address_ + get_rva(binary, section.virtual_address());
+    plt_ranges.emplace_back(start, start + section.size());
+
+    const std::vector<uint8_t> &content = section.content();
+    const size_t entry_size = section.entry_size() ? section.entry_size() : 16;
+    for (size_t entry = 0; entry + entry_size <= content.size();
+         entry += entry_size) {
+      for (size_t off = entry; off + 6 <= entry + entry_size; ++off) {
+        if (content[off] != 0xff || content[off + 1] != 0x25) {
+          continue;
+        }
+        const auto disp =
+            static_cast<int32_t>(intmem::loadu_le<uint32_t>(&content[off + 2]));
+        const uint64_t slot = start + off + 6 + disp;
+        const auto it_slot = got_targets.find(slot);
+        if (it_slot != std::end(got_targets)) {
+          stub_targets.emplace(start + entry, it_slot->second);
+        }
+        break;
+      }
+    }
+  }
+
+  // Lazily bound slots still point to the PLT
+  for (auto it = std::begin(stub_targets); it != std::end(stub_targets);) {
+    const uint64_t target = it->second;
+    const bool unresolved =
+        target == 0 ||
+        std::any_of(std::begin(plt_ranges), std::end(plt_ranges),
+                    [target](const std::pair<uint64_t, uint64_t> &range) {
+                      return target >= range.first && target < range.second;
+                    });
+    it = unresolved ? stub_targets.erase(it) : std::next(it);
+  }
+  if (stub_targets.empty()) {
+    return 0;
+  }
+
+  // Call sites are found by decoding the functions of the symbol tables
+  // from their first instruction, so that the bytes of other instructions
+  // are never taken for calls.
+  std::vector<FunctionSymbol> functions = function_symbols();
+  std::sort(std::begin(functions), std::end(functions),
+            [](const FunctionSymbol &lhs, const FunctionSymbol &rhs) {
+              return lhs.address < rhs.address;
+            });
+
+  size_t patched = 0;
+  for (const Section &section : binary.sections()) {
+    if (!section.has(ELF_SECTION_FLAGS::SHF_EXECINSTR) || is_plt(section)) {
+      continue;
+    }
+    const uint64_t start =
+        base_address_ + get_rva(binary, section.virtual_address());
+    const std::vector<uint8_t> &content = section.content();
+    const uint64_t end = start + content.size();
+    auto it_func = std::lower_bound(
+        std::begin(functions), std::end(functions), start,
+        [](const FunctionSymbol &func, uint64_t addr) {
+          return func.address < addr;
+        });
+    uint64_t last = 0;
+    for (; it_func != std::end(functions) && it_func->address < end;
+         ++it_func) {
+      // Aliases
+      if (it_func->size == 0 || it_func->address == last) {
+        continue;
+      }
+      last = it_func->address;
+      size_t off = it_func->address - start;
+      const size_t stop = std::min(off + it_func->size, content.size());
+      while (off < stop) {
+        const size_t len = x86_64::insn_length(&content[off], stop - off);
+        if (len == 0) {
+          // Unknown instruction: the rest of the function is left untouched
+          break;
+        }
+        // call rel32 / jmp rel32, without prefixes
+        if (len == 5 && (content[off] == 0xe8 || content[off] == 0xe9)) {
+          const uint64_t next_insn = start + off + 5;
+          const auto disp = static_cast<int32_t>(
+              intmem::loadu_le<uint32_t>(&content[off + 1]));
+          const auto it_stub = stub_targets.find(next_insn + disp);
+          if (it_stub != std::end(stub_targets)) {
+            const auto new_disp =
+                static_cast<int64_t>(it_stub->second - next_insn);
+            if (new_disp == static_cast<int32_t>(new_disp)) {
+              uint8_t buf[4];
+              intmem::storeu_le<uint32_t>(buf,
+                                          static_cast<uint32_t>(new_disp));
+              engine_->mem().write(start + off + 1, buf, sizeof(buf));
+              ++patched;
+            }
+          }
+        }
+        off += len;
+      }
+    }
+  }
+  QBDL_DEBUG("PLT bypass: {} call sites patched", patched);
+  return patched;
 }
 
 uintptr_t ELF::resolve(const LIEF::ELF::Symbol &sym) {
@@ -197,18 +865,149 @@ uintptr_t ELF::resolve(const LIEF::ELF::Symbol &sym) {
   if (it_sym == std::end(sym_exp_)) {
     return 0;
   }
-  return get_address(it_sym->second->value());
+  const Symbol &exported = *it_sym->second;
+  const uint64_t addr = get_address(exported.value());
+  if (exported.type() == ELF_SYMBOL_TYPES::STT_GNU_IFUNC) {
+    return engine_->ifunc_resolve(*this, addr);
+  }
+  return addr;
 }
 
-uintptr_t ELF::resolve_or_symlink(const LIEF::ELF::Symbol &sym) {
+uintptr_t ELF::resolve_local(const LIEF::ELF::Symbol &sym) {
   // First check if the symbol is not exported by the binary itself:
   uintptr_t ret = resolve(sym);
+  if (ret == 0 && sym.name() == "__tls_get_addr") {
+    // Blocks of the loaded binaries are only known to our TLS handler
+    if (TargetTLS *tls = engine_->tls()) {
+      ret = tls->get_addr_function();
+    }
+  }
+  return ret;
+}
+
+uintptr_t ELF::resolve_or_symlink(const LIEF::ELF::Symbol &sym) {
+  uintptr_t ret = resolve_local(sym);
   if (ret == 0) {
     ret = engine_->symlink(*this, sym);
   }
+  QBDL_PROBE2(symbol_resolve, sym.name().c_str(), ret);
   return ret;
 }
 
+void ELF::register_tls() {
+  const Binary &binary = get_binary();
+  for (const Segment &segment : binary.segments()) {
+    if (segment.type() != SEGMENT_TYPES::PT_TLS) {
+      continue;
+    }
+    TargetTLS *tls = engine_->tls();
+    if (tls == nullptr) {
+      Logger::warn("The target system does not support thread-local storage");
+      return;
+    }
+    tls_module_ = tls->add_module(
+        base_address_ + get_rva(binary, segment.virtual_address()),
+        segment.physical_size(), segment.virtual_size(), segment.alignment());
+    break;
+  }
+  if (tls_module_ == 0) {
+    return;
+  }
+
+  // The initial-exec model needs a static block: the TLS descriptors can
+  // then use it as well
+  const auto is_tpoff = [this](const Relocation &reloc) {
+    if (relocator_ == &ELF::reloc_x86_64) {
+      return static_cast<RELOC_x86_64>(reloc.type()) ==
+             RELOC_x86_64::R_X86_64_TPOFF64;
+    }
+    return static_cast<RELOC_AARCH64>(reloc.type()) ==
+           RELOC_AARCH64::R_AARCH64_TLS_TPREL64;
+  };
+  tls_static_ = false;
+  for (const Relocation &reloc : binary.dynamic_relocations()) {
+    if (is_tpoff(reloc)) {
+      tls_static_ = true;
+      return;
+    }
+  }
+}
+
+void ELF::reloc_tls(const Relocation &reloc, TLS_RELOC kind) {
+  const Arch binarch = arch();
+  const uintptr_t addr_target = base_address_ + reloc.address();
+  if (tls_module_ == 0) {
+    Logger::err("TLS relocation at 0x{:x} without a TLS module",
+                reloc.address());
+    return;
+  }
+  TargetTLS &tls = *engine_->tls();
+
+  // Only variables defined by this binary are supported: their value is
+  // their offset in the TLS block.
+  uint64_t offset = reloc.addend();
+  if (reloc.has_symbol()) {
+    const Symbol &sym = reloc.symbol();
+    if (sym.shndx() == 0 && !sym.name().empty()) {
+      Logger::err("TLS variable '{}' is defined by another binary, which is "
+                  "not supported",
+                  sym.name());
+      return;
+    }
+    offset += sym.value();
+  }
+
+  switch (kind) {
+  case TLS_RELOC::DTPMOD: {
+    engine_->mem().write_ptr(binarch, addr_target, tls_module_);
+    break;
+  }
+
+  case TLS_RELOC::DTPOFF: {
+    engine_->mem().write_ptr(binarch, addr_target, offset);
+    break;
+  }
+
+  case TLS_RELOC::TLSDESC:
+    if (!tls_static_) {
+      const uint64_t resolver = tls.tlsdesc_dynamic_function();
+      const uint64_t argument =
+          resolver == 0 ? 0 : tls.tlsdesc_argument(tls_module_, offset);
+      if (argument == 0) {
+        Logger::err("TLS descriptors are not supported by the target system");
+        return;
+      }
+      engine_->mem().write_ptr(binarch, addr_target, resolver);
+      engine_->mem().write_ptr(binarch, addr_target + sizeof(uint64_t),
+                               argument);
+      break;
+    }
+    [[fallthrough]];
+
+  case TLS_RELOC::TPOFF: {
+    int64_t block_offset = 0;
+    if (!tls.static_offset(tls_module_, block_offset)) {
+      return;
+    }
+    const uint64_t tp_offset = static_cast<uint64_t>(block_offset) + offset;
+    if (kind == TLS_RELOC::TPOFF) {
+      engine_->mem().write_ptr(binarch, addr_target, tp_offset);
+      break;
+    }
+    const uint64_t resolver = tls.tlsdesc_static_function();
+    if (resolver == 0) {
+      Logger::err("TLS descriptors are not supported by the target system");
+      return;
+    }
+    // A descriptor is a resolver followed by its argument
+    engine_->mem().write_ptr(binarch, addr_target, resolver);
+    engine_->mem().write_ptr(binarch, addr_target + sizeof(uint64_t),
+                             tp_offset);
+    break;
+  }
+  }
+}
+
 void ELF::reloc_x86_64(const LIEF::ELF::Relocation &reloc) {
   const Arch binarch = arch();
   const auto type = static_cast<RELOC_x86_64>(reloc.type());
@@ -238,6 +1037,28 @@ void ELF::reloc_x86_64(const LIEF::ELF::Relocation &reloc) {
     break;
   }
 
+  case RELOC_x86_64::R_X86_64_IRELATIVE: {
+    irelative_relocs_.push_back(&reloc);
+    break;
+  }
+
+  case RELOC_x86_64::R_X86_64_DTPMOD64: {
+    reloc_tls(reloc, TLS_RELOC::DTPMOD);
+    break;
+  }
+  case RELOC_x86_64::R_X86_64_DTPOFF64: {
+    reloc_tls(reloc, TLS_RELOC::DTPOFF);
+    break;
+  }
+  case RELOC_x86_64::R_X86_64_TPOFF64: {
+    reloc_tls(reloc, TLS_RELOC::TPOFF);
+    break;
+  }
+  case RELOC_x86_64::R_X86_64_TLSDESC: {
+    reloc_tls(reloc, TLS_RELOC::TLSDESC);
+    break;
+  }
+
   default: {
     Logger::warn("Relocation type '{}' is not supported!", to_string(type));
   }
@@ -281,6 +1102,28 @@ void ELF::reloc_aarch64(const LIEF::ELF::Relocation &reloc) {
     break;
   }
 
+  case RELOC_AARCH64::R_AARCH64_IRELATIVE: {
+    irelative_relocs_.push_back(&reloc);
+    break;
+  }
+
+  case RELOC_AARCH64::R_AARCH64_TLS_DTPMOD64: {
+    reloc_tls(reloc, TLS_RELOC::DTPMOD);
+    break;
+  }
+  case RELOC_AARCH64::R_AARCH64_TLS_DTPREL64: {
+    reloc_tls(reloc, TLS_RELOC::DTPOFF);
+    break;
+  }
+  case RELOC_AARCH64::R_AARCH64_TLS_TPREL64: {
+    reloc_tls(reloc, TLS_RELOC::TPOFF);
+    break;
+  }
+  case RELOC_AARCH64::R_AARCH64_TLSDESC: {
+    reloc_tls(reloc, TLS_RELOC::TLSDESC);
+    break;
+  }
+
   default: {
     Logger::warn("Relocation type '{}' is not supported!", to_string(type));
   }
@@ -294,6 +1137,14 @@ uint64_t ELF::get_rva(const Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-ELF::~ELF() = default;
+ELF::~ELF() {
+  stop_background_binding();
+  if (!profile_path_.empty()) {
+    save_profile();
+  }
+  if (tls_module_ != 0) {
+    engine_->tls()->remove_module(tls_module_);
+  }
+}
 
 } // namespace QBDL::Loaders
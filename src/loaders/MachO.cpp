@@ -1,16 +1,103 @@
+#include "chained_fixups.hpp"
+#include "fat_header.hpp"
+#include "fixups.hpp"
+#include "intmem.hpp"
 #include "logging.hpp"
+#include "parallel.hpp"
+#include "probes.hpp"
+#include "tracing.hpp"
 #include <LIEF/MachO.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
 #include <QBDL/loaders/MachO.hpp>
 #include <QBDL/utils.hpp>
 
+#include <fstream>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
 // Return this address of the ImageCache
 // See: dyld_stub_binder_dry.s for the implementation
 extern "C" uintptr_t __dyld_stub_binder_dry_call();
 
 namespace QBDL::Loaders {
 
+namespace {
+// Imports are identified by their library ordinal and their name
+struct ImportKey {
+  int32_t library_ordinal;
+  std::string_view name;
+
+  bool operator==(ImportKey const &o) const {
+    return library_ordinal == o.library_ordinal && name == o.name;
+  }
+};
+
+struct ImportKeyHash {
+  size_t operator()(ImportKey const &key) const {
+    return std::hash<std::string_view>{}(key.name) ^
+           static_cast<size_t>(key.library_ordinal);
+  }
+};
+
+// Reads the slice of a universal Mach-O that matches arch, without parsing
+// the other ones.
+// Returns false if path is not a universal Mach-O. Otherwise, slice is
+// empty if no slice matches.
+bool read_fat_slice(const char *path, Arch const &arch,
+                    std::vector<uint8_t> &slice) {
+  std::ifstream ifs{path, std::ios::binary};
+  std::vector<uint8_t> header(8);
+  if (!ifs.read(reinterpret_cast<char *>(header.data()), header.size())) {
+    return false;
+  }
+  const size_t header_size = fat_header_size(header.data());
+  if (header_size == 0) {
+    return false;
+  }
+  header.resize(header_size);
+  if (!ifs.read(reinterpret_cast<char *>(header.data() + 8),
+                header_size - 8)) {
+    return false;
+  }
+  for (const FatSlice &entry : fat_slices(header.data())) {
+    const std::optional<Arch> slice_arch = fat_arch(entry.cputype);
+    if (!slice_arch || *slice_arch != arch) {
+      continue;
+    }
+    slice.resize(entry.size);
+    if (!ifs.seekg(entry.offset) ||
+        !ifs.read(reinterpret_cast<char *>(slice.data()), entry.size)) {
+      Logger::err("Can't read the slice at 0x{:x} in {}", entry.offset, path);
+      slice.clear();
+    }
+    return true;
+  }
+  return true;
+}
+
+// Whether the segment that contains address is executable
+bool is_executable(const LIEF::MachO::Binary &binary, uint64_t address) {
+  static constexpr uint32_t VM_PROT_EXECUTE = 4;
+  const LIEF::MachO::SegmentCommand *segment =
+      binary.segment_from_virtual_address(address);
+  return segment != nullptr &&
+         (segment->init_protection() & VM_PROT_EXECUTE) != 0;
+}
+
+// Name of the type of a section relocation, for error messages
+const char *section_reloc_name(const LIEF::MachO::Relocation &reloc,
+                               bool is_arm64) {
+  if (is_arm64) {
+    return LIEF::MachO::to_string(
+        static_cast<LIEF::MachO::ARM64_RELOCATION>(reloc.type()));
+  }
+  return LIEF::MachO::to_string(
+      static_cast<LIEF::MachO::X86_64_RELOCATION>(reloc.type()));
+}
+} // namespace
+
 std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
                                         TargetSystem &engine, BIND binding) {
   Logger::info("Loading {}", path);
@@ -18,6 +105,25 @@ std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
     Logger::err("{} is not a Mach-O file", path);
     return {};
   }
+
+  // Universal binary: only parse the slice we need
+  std::vector<uint8_t> slice;
+  if (read_fat_slice(path, arch, slice)) {
+    if (slice.empty()) {
+      Logger::err("Unable to find a binary that match given architecture");
+      return {};
+    }
+    std::unique_ptr<LIEF::MachO::FatBinary> fat =
+        LIEF::MachO::Parser::parse(slice, path);
+    // Not needed anymore: LIEF keeps its own copy
+    std::vector<uint8_t>{}.swap(slice);
+    if (fat == nullptr || fat->size() == 0) {
+      Logger::err("Can't parse {}", path);
+      return {};
+    }
+    return from_binary(fat->take(0), engine, binding);
+  }
+
   std::unique_ptr<LIEF::MachO::FatBinary> fat =
       LIEF::MachO::Parser::parse(path);
   if (fat == nullptr || fat->size() == 0) {
@@ -35,12 +141,36 @@ std::unique_ptr<MachO> MachO::from_file(const char *path, Arch const &arch,
 std::unique_ptr<MachO>
 MachO::from_binary(std::unique_ptr<LIEF::MachO::Binary> bin,
                    TargetSystem &engine, BIND binding) {
+  std::unique_ptr<MachO> loader = plan(std::move(bin), engine);
+  if (!loader || !loader->load(binding)) {
+    return {};
+  }
+  return loader;
+}
+
+std::unique_ptr<MachO> MachO::plan(std::unique_ptr<LIEF::MachO::Binary> bin,
+                                   TargetSystem &engine) {
   if (!engine.supports(*bin)) {
     Logger::err("Engine does not support binary!");
     return {};
   }
   std::unique_ptr<MachO> loader(new MachO{std::move(bin), engine});
-  loader->load(binding);
+  const LIEF::MachO::Binary &binary = loader->get_binary();
+
+  // TODO(romain): Could be moved in LIEF
+  uint64_t virtual_size = 0;
+  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+    virtual_size = std::max(virtual_size,
+                            segment.virtual_address() + segment.virtual_size());
+  }
+  virtual_size -= binary.imagebase();
+  virtual_size = page_align(virtual_size);
+  loader->mem_size_ = virtual_size;
+
+  QBDL_DEBUG("Virtual size: 0x{:x}", virtual_size);
+  if (!loader->parse_chained_fixups()) {
+    return {};
+  }
   return loader;
 }
 
@@ -55,6 +185,109 @@ MachO::take_arch_binary(LIEF::MachO::FatBinary &fatbin, Arch const &arch) {
   return {};
 }
 
+bool MachO::parse_chained_fixups() {
+  // LIEF 0.11 does not know about this command: parse its linkedit_data_command
+  static constexpr uint32_t LC_DYLD_CHAINED_FIXUPS = 0x80000034;
+  const LIEF::MachO::Binary &binary = get_binary();
+  for (const LIEF::MachO::LoadCommand &cmd : binary.commands()) {
+    if (static_cast<uint32_t>(cmd.command()) != LC_DYLD_CHAINED_FIXUPS) {
+      continue;
+    }
+    const std::vector<uint8_t> &raw = cmd.data();
+    const LIEF::MachO::SegmentCommand *linkedit =
+        binary.get_segment("__LINKEDIT");
+    if (raw.size() < 16 || linkedit == nullptr) {
+      Logger::err("Invalid LC_DYLD_CHAINED_FIXUPS command");
+      return false;
+    }
+    const uint32_t dataoff = intmem::loadu_le<uint32_t>(&raw[8]);
+    const uint32_t datasize = intmem::loadu_le<uint32_t>(&raw[12]);
+    const std::vector<uint8_t> &content = linkedit->content();
+    if (dataoff < linkedit->file_offset() ||
+        dataoff - linkedit->file_offset() + uint64_t(datasize) >
+            content.size()) {
+      Logger::err("LC_DYLD_CHAINED_FIXUPS data is out of __LINKEDIT");
+      return false;
+    }
+    const auto begin =
+        std::begin(content) + (dataoff - linkedit->file_offset());
+    std::vector<uint64_t> segments_size;
+    for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
+      segments_size.push_back(segment.virtual_size());
+    }
+    chained_fixups_ = ChainedFixups::parse({begin, begin + datasize},
+                                           segments_size);
+    if (chained_fixups_ == nullptr) {
+      return false;
+    }
+    QBDL_DEBUG("Chained fixups: {} pages, {} imports",
+               chained_fixups_->pages().size(),
+               chained_fixups_->imports().size());
+    return true;
+  }
+  return true;
+}
+
+bool MachO::apply_chained_fixups() {
+  // Every page is read, patched and written back once. Binds are only
+  // recorded here, and resolved by the binding stage.
+  std::vector<uint8_t> content;
+  std::vector<ChainedFixups::Bind> binds;
+  const uint64_t imagebase = get_binary().imagebase();
+  for (const ChainedFixups::Page &page : chained_fixups_->pages()) {
+    content.resize(page.size);
+    const uint64_t addr = base_address_ + page.rva;
+    engine_->mem().read(content.data(), addr, page.size);
+    if (!chained_fixups_->apply_page(page, content.data(), imagebase,
+                                     base_address_, binds)) {
+      return false;
+    }
+    engine_->mem().write(addr, content.data(), page.size);
+  }
+  chained_binds_.clear();
+  chained_binds_.reserve(binds.size());
+  for (const ChainedFixups::Bind &bind : binds) {
+    chained_binds_.push_back({bind.rva, bind.import, bind.addend});
+  }
+  return true;
+}
+
+void MachO::bind_chained() {
+  const LIEF::MachO::Binary &binary = get_binary();
+  const std::vector<ChainedFixups::Import> &imports =
+      chained_fixups_->imports();
+
+  // Resolve each used import once, concurrently if the target system allows
+  std::vector<bool> used(imports.size());
+  for (const ChainedBind &bind : chained_binds_) {
+    used[bind.import] = true;
+  }
+  std::vector<uint64_t> addresses(imports.size());
+  {
+    QBDL_TRACE_SCOPE("symlink", imports.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(imports.size(), concurrent, [&](size_t idx) {
+      if (!used[idx]) {
+        return;
+      }
+      const std::string name{imports[idx].name};
+      const LIEF::MachO::Symbol *sym = binary.get_symbol(name);
+      addresses[idx] = sym != nullptr
+                           ? engine_->symlink(*this, *sym)
+                           : engine_->symlink(*this, LIEF::Symbol{name});
+      QBDL_DEBUG("Symbol {} resolves to address 0x{:x}", name, addresses[idx]);
+      QBDL_PROBE2(symbol_resolve, name.c_str(), addresses[idx]);
+    });
+  }
+
+  FixupBatch batch{engine_->mem(), arch()};
+  for (const ChainedBind &bind : chained_binds_) {
+    const int64_t addend = imports[bind.import].addend + bind.addend;
+    batch.set_ptr(base_address_ + bind.rva, addresses[bind.import] + addend);
+  }
+  batch.flush();
+}
+
 MachO::MachO(std::unique_ptr<LIEF::MachO::Binary> bin, TargetSystem &engine)
     : Loader::Loader(engine), bin_{std::move(bin)} {}
 
@@ -81,27 +314,30 @@ uint64_t MachO::entrypoint() const {
   return base_address_ + (binary.entrypoint() - binary.imagebase());
 }
 
-bool MachO::load(BIND binding) {
-  LIEF::MachO::Binary &binary = get_binary();
-  const Arch binarch = arch();
-
-  // TODO(romain): Could be moved in LIEF
-  uint64_t virtual_size = 0;
-  for (const LIEF::MachO::SegmentCommand &segment : binary.segments()) {
-    virtual_size = std::max(virtual_size,
-                            segment.virtual_address() + segment.virtual_size());
+bool MachO::reserve() {
+  if (!check_stage(STAGE::PLANNED)) {
+    return false;
   }
-  virtual_size -= binary.imagebase();
-  virtual_size = page_align(virtual_size);
-  mem_size_ = virtual_size;
-
-  Logger::debug("Virtual size: 0x{:x}", virtual_size);
-
+  const LIEF::MachO::Binary &binary = get_binary();
   const uint64_t base_address_hint =
-      engine_->base_address_hint(binary.imagebase(), virtual_size);
+      engine_->base_address_hint(binary.imagebase(), mem_size_);
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().mmap(base_address_hint, mem_size_);
+  if (base_address == 0) {
+    Logger::err("mmap() failed! Abort.");
+    return false;
+  }
   base_address_ = base_address;
+  register_image();
+  stage_ = STAGE::RESERVED;
+  return true;
+}
+
+bool MachO::map() {
+  if (!check_stage(STAGE::RESERVED)) {
+    return false;
+  }
+  const LIEF::MachO::Binary &binary = get_binary();
 
   // Map segments
   // =======================================================
@@ -111,49 +347,297 @@ bool MachO::load(BIND binding) {
     }
     const uint64_t rva = get_rva(binary, segment.virtual_address());
 
-    Logger::debug("Mapping {} - 0x{:x}", segment.name(), rva);
+    QBDL_DEBUG("Mapping {} - 0x{:x}", segment.name(), rva);
     const std::vector<uint8_t> &content = segment.content();
 
     if (content.size() > 0) {
-      engine_->mem().write(base_address + rva, content.data(), content.size());
+      engine_->mem().write(base_address_ + rva, content.data(),
+                           content.size());
+    }
+    QBDL_PROBE3(segment_map, this, base_address_ + rva, content.size());
+  }
+  stage_ = STAGE::MAPPED;
+  return true;
+}
+
+bool MachO::relocate() {
+  if (!check_stage(STAGE::MAPPED)) {
+    return false;
+  }
+  const LIEF::MachO::Binary &binary = get_binary();
+  const Arch binarch = arch();
+  const uint8_t ptr_size = binarch.is64 ? 8 : 4;
+  const uint64_t slide = base_address_ - binary.imagebase();
+
+  if (chained_fixups_ && !apply_chained_fixups()) {
+    return false;
+  }
+
+  // Relocation tables pair SUBTRACTOR relocations with the UNSIGNED one at
+  // the same address
+  std::unordered_map<uint64_t, const LIEF::MachO::Relocation *> subtractors;
+  const bool is_arm64 = binary.header().cpu_type() ==
+                        LIEF::MachO::CPU_TYPES::CPU_TYPE_ARM64;
+  const uint8_t subtractor_type =
+      is_arm64
+          ? static_cast<uint8_t>(
+                LIEF::MachO::ARM64_RELOCATION::ARM64_RELOC_SUBTRACTOR)
+          : static_cast<uint8_t>(
+                LIEF::MachO::X86_64_RELOCATION::X86_64_RELOC_SUBTRACTOR);
+  for (const LIEF::MachO::Relocation &relocation : binary.relocations()) {
+    if (relocation.origin() ==
+            LIEF::MachO::RELOCATION_ORIGINS::ORIGIN_RELOC_TABLE &&
+        relocation.type() == subtractor_type && relocation.has_section()) {
+      subtractors.emplace(relocation.section().virtual_address() +
+                              relocation.address(),
+                          &relocation);
     }
   }
 
   // Perform relocations
   // =======================================================
+  FixupBatch batch{engine_->mem(), binarch};
+  size_t errors = 0;
+  import_relocs_.clear();
   for (const LIEF::MachO::Relocation &relocation : binary.relocations()) {
     if (relocation.origin() ==
         LIEF::MachO::RELOCATION_ORIGINS::ORIGIN_RELOC_TABLE) {
-      Logger::warn("Relocation not handled!");
+      if (relocation.type() == subtractor_type) {
+        continue;
+      }
+      const bool is_extern = relocation.has_symbol();
+      // Instructions that reference a symbol would need a stub or a GOT
+      // entry, that are not created here
+      if (is_arm64 && is_extern &&
+          relocation.type() !=
+              static_cast<uint8_t>(
+                  LIEF::MachO::ARM64_RELOCATION::ARM64_RELOC_UNSIGNED)) {
+        Logger::err("Relocation {} against {} is not supported",
+                    section_reloc_name(relocation, is_arm64),
+                    relocation.symbol().name());
+        ++errors;
+        continue;
+      }
+      const LIEF::MachO::Relocation *subtractor = nullptr;
+      if (!subtractors.empty() && relocation.has_section()) {
+        const auto it = subtractors.find(
+            relocation.section().virtual_address() + relocation.address());
+        if (it != std::end(subtractors)) {
+          subtractor = it->second;
+        }
+      }
+      uint64_t sym_addr = 0;
+      if (is_extern) {
+        const LIEF::MachO::Symbol &sym = relocation.symbol();
+        if (sym.numberof_sections() != 0) {
+          sym_addr = base_address_ + get_rva(binary, sym.value());
+        } else if (subtractor == nullptr) {
+          // Imported symbol: resolved by bind()
+          import_relocs_.push_back(&relocation);
+          continue;
+        }
+      }
+      if (!relocate_section(relocation, subtractor, sym_addr, batch)) {
+        Logger::err("Unable to apply relocation {} at 0x{:x}",
+                    section_reloc_name(relocation, is_arm64),
+                    relocation.address());
+        ++errors;
+      }
       continue;
     }
 
     const auto rtype =
         static_cast<LIEF::MachO::REBASE_TYPES>(relocation.type());
+    const uint64_t rel_ptr =
+        base_address_ + get_rva(binary, relocation.address());
     switch (rtype) {
     case LIEF::MachO::REBASE_TYPES::REBASE_TYPE_POINTER: {
-      const uint64_t rva = get_rva(binary, relocation.address());
-      const uint64_t rel_ptr = base_address + rva;
-      uint64_t rel_ptr_val = engine_->mem().read_ptr(binarch, rel_ptr);
-      if (rel_ptr_val >= binary.imagebase()) {
-        rel_ptr_val -= binary.imagebase();
-      }
-      rel_ptr_val += base_address;
-      engine_->mem().write_ptr(binarch, rel_ptr, rel_ptr_val);
+      batch.push(rel_ptr, slide, ptr_size, FixupBatch::KIND::ADD);
+      break;
+    }
+
+    case LIEF::MachO::REBASE_TYPES::REBASE_TYPE_TEXT_ABSOLUTE32: {
+      batch.push(rel_ptr, slide, 4, FixupBatch::KIND::ADD);
       break;
     }
 
     default: {
-      Logger::warn("Relocation {} not supported yet",
-                   LIEF::MachO::to_string(rtype));
+      Logger::err("Relocation {} at 0x{:x} is not supported",
+                  LIEF::MachO::to_string(rtype), relocation.address());
+      ++errors;
+    }
+    }
+  }
+  if (errors > 0) {
+    Logger::err("Unable to apply {} relocations", errors);
+    return false;
+  }
+  batch.flush();
+  stage_ = STAGE::RELOCATED;
+  return true;
+}
+
+// Applies a relocation from a section relocation table (x86-64 and arm64).
+// \p sym_addr is the address of the symbol of an external relocation.
+// Returns false if it is not supported.
+bool MachO::relocate_section(const LIEF::MachO::Relocation &reloc,
+                             const LIEF::MachO::Relocation *subtractor,
+                             uint64_t sym_addr, FixupBatch &batch) {
+  using LIEF::MachO::ARM64_RELOCATION;
+  using LIEF::MachO::X86_64_RELOCATION;
+  const LIEF::MachO::Binary &binary = get_binary();
+  if (!reloc.has_section()) {
+    return false;
+  }
+  const uint64_t addr =
+      base_address_ +
+      get_rva(binary, reloc.section().virtual_address() + reloc.address());
+  const uint8_t width = reloc.size() / 8;
+  const uint64_t slide = base_address_ - binary.imagebase();
+  const bool is_arm64 = binary.header().cpu_type() ==
+                        LIEF::MachO::CPU_TYPES::CPU_TYPE_ARM64;
+  const bool is_extern = reloc.has_symbol();
+
+  // UNSIGNED has the same value on both architectures
+  if (reloc.type() ==
+      static_cast<uint8_t>(X86_64_RELOCATION::X86_64_RELOC_UNSIGNED)) {
+    if (width != 4 && width != 8) {
+      return false;
+    }
+    if (subtractor != nullptr) {
+      // A - B: the slide cancels out if both are in this binary
+      const bool local =
+          !is_extern || reloc.symbol().numberof_sections() != 0;
+      const bool sub_local = !subtractor->has_symbol() ||
+                             subtractor->symbol().numberof_sections() != 0;
+      return local && sub_local;
     }
+    // The content is the target address, or the addend for an external
+    // symbol
+    const uint64_t delta = is_extern ? sym_addr : slide;
+    batch.push(addr, delta, width, FixupBatch::KIND::ADD);
+    return true;
+  }
+
+  if (is_arm64) {
+    switch (static_cast<ARM64_RELOCATION>(reloc.type())) {
+    // Relative to this binary, and slides are page aligned
+    case ARM64_RELOCATION::ARM64_RELOC_BRANCH26:
+    case ARM64_RELOCATION::ARM64_RELOC_PAGE21:
+    case ARM64_RELOCATION::ARM64_RELOC_PAGEOFF12:
+      return !is_extern;
+    // Only carries the addend of the next relocation
+    case ARM64_RELOCATION::ARM64_RELOC_ADDEND:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  switch (static_cast<X86_64_RELOCATION>(reloc.type())) {
+  case X86_64_RELOCATION::X86_64_RELOC_SIGNED:
+  case X86_64_RELOCATION::X86_64_RELOC_SIGNED_1:
+  case X86_64_RELOCATION::X86_64_RELOC_SIGNED_2:
+  case X86_64_RELOCATION::X86_64_RELOC_SIGNED_4:
+  case X86_64_RELOCATION::X86_64_RELOC_BRANCH: {
+    if (!is_extern) {
+      return true;
+    }
+    // disp32 = S + content - (P + 4), the content being biased for the
+    // SIGNED_n variants
+    const int64_t delta = static_cast<int64_t>(sym_addr - (addr + 4));
+    if (delta != static_cast<int32_t>(delta)) {
+      Logger::err("{} is out of reach from 0x{:x}", reloc.symbol().name(),
+                  addr);
+      return false;
+    }
+    batch.push(addr, static_cast<uint64_t>(delta), 4, FixupBatch::KIND::ADD);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+// Applies the section relocations against imported symbols, that
+// relocate() left aside. Returns false if one of them can't be applied.
+bool MachO::bind_section_relocs() {
+  if (import_relocs_.empty()) {
+    return true;
+  }
+  std::unordered_map<std::string_view, size_t> index;
+  std::vector<const LIEF::MachO::Symbol *> symbols;
+  std::vector<size_t> imports;
+  imports.reserve(import_relocs_.size());
+  for (const LIEF::MachO::Relocation *reloc : import_relocs_) {
+    const LIEF::MachO::Symbol &sym = reloc->symbol();
+    const auto it = index.emplace(sym.name(), symbols.size()).first;
+    if (it->second == symbols.size()) {
+      symbols.push_back(&sym);
+    }
+    imports.push_back(it->second);
+  }
+
+  std::vector<uint64_t> addresses(symbols.size());
+  {
+    QBDL_TRACE_SCOPE("symlink", symbols.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(symbols.size(), concurrent, [&](size_t idx) {
+      addresses[idx] = engine_->symlink(*this, *symbols[idx]);
+      QBDL_PROBE2(symbol_resolve, symbols[idx]->name().c_str(), addresses[idx]);
+    });
+  }
+  const bool is_arm64 = get_binary().header().cpu_type() ==
+                        LIEF::MachO::CPU_TYPES::CPU_TYPE_ARM64;
+  FixupBatch batch{engine_->mem(), arch()};
+  size_t errors = 0;
+  for (size_t idx = 0; idx < import_relocs_.size(); ++idx) {
+    const LIEF::MachO::Relocation &reloc = *import_relocs_[idx];
+    if (!relocate_section(reloc, nullptr, addresses[imports[idx]], batch)) {
+      Logger::err("Unable to apply relocation {} against {}",
+                  section_reloc_name(reloc, is_arm64), reloc.symbol().name());
+      ++errors;
+    }
+  }
+  if (errors > 0) {
+    Logger::err("Unable to apply {} relocations against imports", errors);
+    return false;
+  }
+  batch.flush();
+  QBDL_DEBUG("{} section relocations against {} imports",
+             import_relocs_.size(), symbols.size());
+  return true;
+}
+
+bool MachO::bind(BIND binding) {
+  if (!check_stage(STAGE::RELOCATED)) {
+    return false;
+  }
+
+  // Chained fixups and section relocations have no lazy bindings
+  if (binding != BIND::NOT_BIND) {
+    if (chained_fixups_) {
+      bind_chained();
+    }
+    if (!bind_section_relocs()) {
+      return false;
     }
   }
 
   // Bind symbols
   switch (binding) {
+  // Binding profiles are only recorded by the ELF lazy resolver
+  case BIND::PROFILE:
   case BIND::NOW: {
-    bind_now();
+    bind_now(/* lazy */ false, /* atomic */ false);
+    bind_now(/* lazy */ true, /* atomic */ false);
+    break;
+  }
+
+  case BIND::BACKGROUND: {
+    bind_now(/* lazy */ false, /* atomic */ false);
+    start_background_binding(
+        [this] { bind_now(/* lazy */ true, /* atomic */ true); });
     break;
   }
 
@@ -161,18 +645,32 @@ bool MachO::load(BIND binding) {
   default:
     break;
   }
-
+  stage_ = STAGE::BOUND;
   return true;
 }
 
-void MachO::bind_now() {
+void MachO::bind_now(bool lazy, bool atomic) {
   const LIEF::MachO::Binary &binary = get_binary();
+  if (!binary.has_dyld_info()) {
+    return;
+  }
   const Arch binarch = arch();
+  const LIEF::MachO::BINDING_CLASS binding_class =
+      lazy ? LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY
+           : LIEF::MachO::BINDING_CLASS::BIND_CLASS_STANDARD;
+
+  // The same import is usually bound in many slots: resolve it once
+  struct Slot {
+    uint64_t address;
+    int64_t addend;
+    size_t import;
+  };
+  std::unordered_map<ImportKey, size_t, ImportKeyHash> index;
+  std::vector<const LIEF::MachO::Symbol *> symbols;
+  std::vector<Slot> slots;
   for (const LIEF::MachO::BindingInfo &info : binary.dyld_info().bindings()) {
     // TODO(romain): Add BIND_CLASS_THREADED when moving to LIEF 0.12.0
-    if (info.binding_class() != LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY &&
-        info.binding_class() !=
-            LIEF::MachO::BINDING_CLASS::BIND_CLASS_STANDARD) {
+    if (info.binding_class() != binding_class) {
       continue;
     }
     if (!info.has_symbol()) {
@@ -180,15 +678,111 @@ void MachO::bind_now() {
       continue;
     }
     const auto &sym = info.symbol();
-    const uint64_t ptrRVA = get_rva(binary, info.address());
-    const uint64_t ptrAddr = base_address_ + ptrRVA;
-    const uint64_t symAddr = engine_->symlink(*this, sym);
-    Logger::info(
-        "Symbol {} resolves to address 0x{:x}, stored at address 0x{:x}",
-        sym.name(), symAddr, ptrAddr);
-    // Store the address of the resolved symbol into ptrAddr
-    engine_->mem().write_ptr(binarch, ptrAddr, symAddr);
+    const ImportKey key{info.library_ordinal(), sym.name()};
+    const auto it = index.emplace(key, symbols.size()).first;
+    if (it->second == symbols.size()) {
+      symbols.push_back(&sym);
+    }
+    slots.push_back({base_address_ + get_rva(binary, info.address()),
+                     info.addend(), it->second});
+  }
+
+  // Lazy pointers may be in use by running code: write them one by one
+  if (atomic) {
+    QBDL_TRACE_SCOPE("symlink", symbols.size());
+    std::vector<uint64_t> addresses(symbols.size());
+    std::vector<bool> resolved(symbols.size());
+    for (const Slot &slot : slots) {
+      if (background_binding_stopped()) {
+        return;
+      }
+      if (!resolved[slot.import]) {
+        const LIEF::MachO::Symbol &sym = *symbols[slot.import];
+        addresses[slot.import] = engine_->symlink(*this, sym);
+        QBDL_PROBE2(symbol_resolve, sym.name().c_str(), addresses[slot.import]);
+        resolved[slot.import] = true;
+      }
+      engine_->mem().write_ptr_atomic(binarch, slot.address,
+                                      addresses[slot.import] + slot.addend);
+    }
+    return;
+  }
+
+  std::vector<uint64_t> addresses(symbols.size());
+  {
+    QBDL_TRACE_SCOPE("symlink", symbols.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(symbols.size(), concurrent, [&](size_t idx) {
+      addresses[idx] = engine_->symlink(*this, *symbols[idx]);
+      QBDL_DEBUG("Symbol {} resolves to address 0x{:x}",
+                 symbols[idx]->name(), addresses[idx]);
+      QBDL_PROBE2(symbol_resolve, symbols[idx]->name().c_str(), addresses[idx]);
+    });
+  }
+  FixupBatch batch{engine_->mem(), binarch};
+  for (const Slot &slot : slots) {
+    batch.set_ptr(slot.address, addresses[slot.import] + slot.addend);
+  }
+  batch.flush();
+  QBDL_DEBUG("{} {} bindings to {} imports", slots.size(),
+             lazy ? "lazy" : "standard", symbols.size());
+}
+
+std::vector<ImportSlot> MachO::import_slots() const {
+  const LIEF::MachO::Binary &binary = get_binary();
+  std::vector<ImportSlot> slots;
+  if (chained_fixups_) {
+    const std::vector<ChainedFixups::Import> &imports =
+        chained_fixups_->imports();
+    for (const ChainedBind &bind : chained_binds_) {
+      const ChainedFixups::Import &import = imports[bind.import];
+      slots.push_back({import.name, base_address_ + bind.rva,
+                       import.addend + bind.addend, false});
+    }
+  }
+  if (!binary.has_dyld_info()) {
+    return slots;
+  }
+  for (const LIEF::MachO::BindingInfo &info : binary.dyld_info().bindings()) {
+    if (!info.has_symbol()) {
+      continue;
+    }
+    slots.push_back(
+        {info.symbol().name(), base_address_ + get_rva(binary, info.address()),
+         info.addend(),
+         info.binding_class() == LIEF::MachO::BINDING_CLASS::BIND_CLASS_LAZY});
+  }
+  return slots;
+}
+
+std::vector<FunctionSymbol> MachO::function_symbols() const {
+  static constexpr uint8_t N_STAB = 0xe0;
+  const LIEF::MachO::Binary &binary = get_binary();
+  std::vector<FunctionSymbol> functions;
+  for (const LIEF::MachO::Symbol &sym : binary.symbols()) {
+    // Symbols defined in an executable segment, without debug entries
+    if (sym.numberof_sections() == 0 || (sym.type() & N_STAB) != 0 ||
+        !is_executable(binary, sym.value())) {
+      continue;
+    }
+    functions.push_back(
+        {sym.name(), base_address_ + get_rva(binary, sym.value()), 0});
+  }
+  return functions;
+}
+
+std::vector<ExportedSymbol> MachO::exported_symbols() const {
+  const LIEF::MachO::Binary &binary = get_binary();
+  std::vector<ExportedSymbol> exports;
+  for (const LIEF::MachO::Symbol &sym : binary.exported_symbols()) {
+    // The export trie does not tell code from data
+    const ExportedSymbol::KIND kind = is_executable(binary, sym.value())
+                                          ? ExportedSymbol::KIND::FUNCTION
+                                          : ExportedSymbol::KIND::DATA;
+    exports.push_back(
+        {sym.name(), base_address_ + get_rva(binary, sym.value()), kind});
   }
+  return exports;
 }
 
 uint64_t MachO::get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const {
@@ -198,6 +792,6 @@ uint64_t MachO::get_rva(const LIEF::MachO::Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-MachO::~MachO() = default;
+MachO::~MachO() { stop_background_binding(); }
 
 } // namespace QBDL::Loaders
@@ -1,14 +1,57 @@
+#include "base_relocations.hpp"
+#include "fixups.hpp"
+#include "intmem.hpp"
 #include "logging.hpp"
+#include "parallel.hpp"
+#include "probes.hpp"
+#include "tracing.hpp"
 #include <LIEF/PE.hpp>
 #include <QBDL/Engine.hpp>
 #include <QBDL/arch.hpp>
 #include <QBDL/loaders/PE.hpp>
 #include <QBDL/utils.hpp>
 
+#include <cstdlib>
+
 using namespace LIEF::PE;
 
+#if defined(QBDL_LAZY_BINDING) && defined(__x86_64__)
+#define QBDL_PE_DELAY_LAZY 1
+// See pe_delay_x86_64.S
+extern "C" void _pe_delay_resolve_internal();
+#endif
+
 namespace QBDL::Loaders {
 
+// This function is called by _pe_delay_resolve_internal() with the index of
+// the delay-load import to resolve. The trampoline jumps to the returned
+// address, so the process is aborted if there is none.
+uintptr_t PE::delay_resolve(void *loader, uintptr_t index) {
+  auto &ldr = *reinterpret_cast<QBDL::Loaders::PE *>(loader);
+  if (index >= ldr.delay_imports_.size()) {
+    QBDL::Logger::err("Delay-load import index out of range: {:d}", index);
+    std::abort();
+  }
+  QBDL_TRACE_SCOPE("lazy_bind", ldr.delay_imports_[index].name);
+  const uint64_t addr = ldr.resolve_delay_import(index);
+  if (addr == 0) {
+    const DelayImport &imp = ldr.delay_imports_[index];
+    if (imp.by_ordinal) {
+      QBDL::Logger::err("Unable to resolve the delay-load import {}!#{:d}",
+                        imp.dll, imp.ordinal);
+    } else {
+      QBDL::Logger::err("Unable to resolve the delay-load import {}!{}",
+                        imp.dll, imp.name);
+    }
+    std::abort();
+  }
+  const uint64_t iat_addr =
+      ldr.base_address_ + ldr.delay_imports_[index].iat_rva;
+  ldr.engine_->mem().write_ptr_atomic(ldr.arch(), iat_addr, addr);
+  QBDL_PROBE2(lazy_bind, ldr.delay_imports_[index].name.c_str(), addr);
+  return addr;
+}
+
 std::unique_ptr<PE> PE::from_file(const char *path, TargetSystem &engines,
                                   BIND binding) {
   Logger::info("Loading {}", path);
@@ -26,11 +69,25 @@ std::unique_ptr<PE> PE::from_file(const char *path, TargetSystem &engines,
 
 std::unique_ptr<PE> PE::from_binary(std::unique_ptr<Binary> bin,
                                     TargetSystem &engines, BIND binding) {
+  std::unique_ptr<PE> loader = plan(std::move(bin), engines);
+  if (!loader || !loader->load(binding)) {
+    return {};
+  }
+  return loader;
+}
+
+std::unique_ptr<PE> PE::plan(std::unique_ptr<Binary> bin,
+                             TargetSystem &engines) {
   if (!engines.supports(*bin)) {
     return {};
   }
   std::unique_ptr<PE> loader(new PE{std::move(bin), engines});
-  loader->load(binding);
+
+  uint64_t virtual_size = loader->get_binary().virtual_size();
+  virtual_size = page_align(virtual_size);
+  loader->mem_size_ = virtual_size;
+
+  QBDL_DEBUG("Virtual size: 0x{:x}", virtual_size);
   return loader;
 }
 
@@ -59,29 +116,33 @@ uint64_t PE::entrypoint() const {
          (binary.entrypoint() - binary.optional_header().imagebase());
 }
 
-void PE::load(BIND binding) {
-  Binary &binary = get_binary();
-  const uint64_t imagebase = binary.optional_header().imagebase();
-
-  uint64_t virtual_size = binary.virtual_size();
-  virtual_size = page_align(virtual_size);
-  mem_size_ = virtual_size;
-
-  Logger::debug("Virtual size: 0x{:x}", virtual_size);
-
+bool PE::reserve() {
+  if (!check_stage(STAGE::PLANNED)) {
+    return false;
+  }
+  const uint64_t imagebase = get_binary().optional_header().imagebase();
   const uint64_t base_address_hint =
-      engine_->base_address_hint(imagebase, virtual_size);
+      engine_->base_address_hint(imagebase, mem_size_);
   const uint64_t base_address =
-      engine_->mem().mmap(base_address_hint, virtual_size);
+      engine_->mem().mmap(base_address_hint, mem_size_);
   if (base_address == 0 || base_address == -1ull) {
     Logger::err("mmap() failed! Abort.");
-    return;
+    return false;
   }
   base_address_ = base_address;
+  register_image();
+  stage_ = STAGE::RESERVED;
+  return true;
+}
+
+bool PE::map() {
+  if (!check_stage(STAGE::RESERVED)) {
+    return false;
+  }
 
   // Map sections
   // =======================================================
-  for (const Section &section : binary.sections()) {
+  for (const Section &section : get_binary().sections()) {
     QBDL_DEBUG("Mapping: {:<10}: (0x{:06x} - 0x{:06x})", section.name(),
                section.virtual_address(),
                section.virtual_address() + section.virtual_size());
@@ -90,53 +151,369 @@ void PE::load(BIND binding) {
     if (!content.empty()) {
       engine_->mem().write(base_address_ + rva, content.data(), content.size());
     }
+    QBDL_PROBE3(segment_map, this, base_address_ + rva, content.size());
   }
+  stage_ = STAGE::MAPPED;
+  return true;
+}
+
+bool PE::relocate() {
+  if (!check_stage(STAGE::MAPPED)) {
+    return false;
+  }
+  const Binary &binary = get_binary();
+  const uint64_t imagebase = binary.optional_header().imagebase();
 
   // Perform relocations
   // =======================================================
   if (binary.has_relocations()) {
-    const Arch binarch = arch();
     const uint64_t fixup = base_address_ - imagebase;
+    // A block covers one page: read it, patch it and write it back at once
+    FixupBatch batch{engine_->mem(), arch()};
     for (const Relocation &relocation : binary.relocations()) {
-      const uint64_t rva = relocation.virtual_address();
+      const uint64_t block_addr = base_address_ + relocation.virtual_address();
       for (const RelocationEntry &entry : relocation.entries()) {
-        switch (entry.type()) {
-        case RELOCATIONS_BASE_TYPES::IMAGE_REL_BASED_DIR64: {
-          const uint64_t relocation_addr =
-              base_address_ + rva + entry.position();
-          const uint64_t value =
-              engine_->mem().read_ptr(binarch, relocation_addr);
-          engine_->mem().write_ptr(binarch, relocation_addr, value + fixup);
-          break;
-        }
-
-        default: {
+        if (!push_base_relocation(batch, static_cast<uint8_t>(entry.type()),
+                                  block_addr + entry.position(), fixup)) {
           QBDL_ERROR("PE relocation {} is not supported!",
                      to_string(entry.type()));
-          break;
-        }
         }
       }
+      batch.flush();
     }
   }
+  stage_ = STAGE::RELOCATED;
+  return true;
+}
+
+bool PE::bind(BIND binding) {
+  if (!check_stage(STAGE::RELOCATED)) {
+    return false;
+  }
+  const Binary &binary = get_binary();
+  if (!parse_delay_imports()) {
+    return false;
+  }
 
   // Perform symbol resolution
   // =======================================================
-  // TODO(romain): Find a mechanism to support import by ordinal
+  // Imports by ordinal are left to TargetSystem::symlink_import
   if (binary.has_imports()) {
-    const Arch binarch = arch();
+    std::vector<ImportView> views;
+    std::vector<uint64_t> iat;
     for (const Import &imp : binary.imports()) {
       for (const ImportEntry &entry : imp.entries()) {
-        const uint64_t iat_addr = entry.iat_address();
-        QBDL_DEBUG("Resolving: {}:{} (0x{:x})", imp.name(), entry.name(),
-                   iat_addr);
-        LIEF::Symbol sym{entry.name()};
-        const uintptr_t sym_addr = engine_->symlink(*this, sym);
-        // Write the value in the IAT:
-        engine_->mem().write_ptr(binarch, base_address_ + iat_addr, sym_addr);
+        views.push_back({imp.name(), entry.name(), entry.ordinal(),
+                         entry.hint(), entry.is_ordinal()});
+        iat.push_back(base_address_ + entry.iat_address());
       }
     }
+    std::vector<uint64_t> addresses(views.size());
+    {
+      QBDL_TRACE_SCOPE("symlink", views.size());
+      const bool concurrent = engine_->thread_safe_symlink();
+      parallel_for(views.size(), concurrent, [&](size_t idx) {
+        QBDL_DEBUG("Resolving: {}:{} (0x{:x})", views[idx].library,
+                   views[idx].name, iat[idx]);
+        addresses[idx] = engine_->symlink_import(*this, views[idx]);
+        QBDL_PROBE2(symbol_resolve, views[idx].name.data(), addresses[idx]);
+      });
+    }
+    // Write the values in the IAT:
+    FixupBatch batch{engine_->mem(), arch()};
+    for (size_t idx = 0; idx < views.size(); ++idx) {
+      batch.set_ptr(iat[idx], addresses[idx]);
+    }
+    batch.flush();
+  }
+
+  // Delay-load imports
+  switch (binding) {
+  case BIND::LAZY: {
+    if (!bind_delay_lazy()) {
+      bind_delay_now(/* atomic */ false);
+    }
+    break;
+  }
+
+  case BIND::BACKGROUND: {
+    if (bind_delay_lazy()) {
+      start_background_binding([this] { bind_delay_now(/* atomic */ true); });
+    } else {
+      bind_delay_now(/* atomic */ false);
+    }
+    break;
+  }
+
+  case BIND::NOW:
+  case BIND::PROFILE: {
+    bind_delay_now(/* atomic */ false);
+    break;
   }
+
+  case BIND::NOT_BIND:
+    break;
+  }
+  stage_ = STAGE::BOUND;
+  return true;
+}
+
+bool PE::parse_delay_imports() {
+  static constexpr size_t DESCRIPTOR_SIZE = 32;
+  const Binary &binary = get_binary();
+  delay_imports_.clear();
+  if (!binary.has(DATA_DIRECTORY::DELAY_IMPORT_DESCRIPTOR)) {
+    return true;
+  }
+  const DataDirectory &dir =
+      binary.data_directory(DATA_DIRECTORY::DELAY_IMPORT_DESCRIPTOR);
+  if (dir.RVA() == 0) {
+    return true;
+  }
+
+  const Arch binarch = arch();
+  const uint64_t ptr_size = binarch.is64 ? 8 : 4;
+  const uint64_t ordinal_flag = 1ULL << (ptr_size * 8 - 1);
+  TargetMemory &mem = engine_->mem();
+  for (uint64_t desc = dir.RVA(); desc + DESCRIPTOR_SIZE <= mem_size_;
+       desc += DESCRIPTOR_SIZE) {
+    // IMAGE_DELAYLOAD_DESCRIPTOR
+    uint32_t fields[DESCRIPTOR_SIZE / sizeof(uint32_t)];
+    mem.read(fields, base_address_ + desc, sizeof(fields));
+    const uint32_t attributes = intmem::bswap_le(fields[0]);
+    const uint32_t dll_name_rva = intmem::bswap_le(fields[1]);
+    const uint32_t iat_rva = intmem::bswap_le(fields[3]);
+    const uint32_t int_rva = intmem::bswap_le(fields[4]);
+    if (dll_name_rva == 0) {
+      break;
+    }
+    const std::string dll = read_string(base_address_ + dll_name_rva);
+    // Descriptors without the RvaBased attribute come from Visual C++ 6 and
+    // hold virtual addresses
+    if ((attributes & 1) == 0) {
+      Logger::err("Delay-load descriptor of {} is not RVA-based", dll);
+      return false;
+    }
+    for (uint64_t idx = 0;; ++idx) {
+      const uint64_t int_entry = int_rva + idx * ptr_size;
+      if (int_entry + ptr_size > mem_size_) {
+        Logger::err("Delay-load name table of {} is out of the image", dll);
+        return false;
+      }
+      const uint64_t thunk = mem.read_ptr(binarch, base_address_ + int_entry);
+      if (thunk == 0) {
+        break;
+      }
+      DelayImport imp{dll, {}, 0, 0, false, iat_rva + idx * ptr_size};
+      if (thunk & ordinal_flag) {
+        imp.by_ordinal = true;
+        imp.ordinal = thunk & 0xFFFF;
+      } else {
+        // IMAGE_IMPORT_BY_NAME: hint followed by the name
+        uint16_t hint;
+        mem.read(&hint, base_address_ + thunk, sizeof(hint));
+        imp.hint = intmem::bswap_le(hint);
+        imp.name = read_string(base_address_ + thunk + sizeof(uint16_t));
+      }
+      delay_imports_.push_back(std::move(imp));
+    }
+  }
+  QBDL_DEBUG("{} delay-load imports", delay_imports_.size());
+  return true;
+}
+
+uint64_t PE::resolve_delay_import(size_t index) {
+  const DelayImport &imp = delay_imports_[index];
+  QBDL_DEBUG("Resolving: {}:{} (delay-load)", imp.dll, imp.name);
+  const ImportView view{imp.dll, imp.name, imp.ordinal, imp.hint,
+                        imp.by_ordinal};
+  const uint64_t addr = engine_->symlink_import(*this, view);
+  QBDL_PROBE2(symbol_resolve, imp.name.c_str(), addr);
+  return addr;
+}
+
+void PE::bind_delay_now(bool atomic) {
+  const Arch binarch = arch();
+  // Slots may be in use by running code: write them one by one
+  if (atomic) {
+    for (size_t idx = 0; idx < delay_imports_.size(); ++idx) {
+      if (background_binding_stopped()) {
+        return;
+      }
+      const uint64_t sym_addr = resolve_delay_import(idx);
+      const uint64_t iat_addr = base_address_ + delay_imports_[idx].iat_rva;
+      engine_->mem().write_ptr_atomic(binarch, iat_addr, sym_addr);
+    }
+    return;
+  }
+
+  std::vector<uint64_t> addresses(delay_imports_.size());
+  {
+    QBDL_TRACE_SCOPE("symlink", addresses.size());
+    const bool concurrent = engine_->thread_safe_symlink();
+    parallel_for(addresses.size(), concurrent, [&](size_t idx) {
+      addresses[idx] = resolve_delay_import(idx);
+    });
+  }
+  FixupBatch batch{engine_->mem(), binarch};
+  for (size_t idx = 0; idx < addresses.size(); ++idx) {
+    batch.set_ptr(base_address_ + delay_imports_[idx].iat_rva, addresses[idx]);
+  }
+  batch.flush();
+}
+
+// Points the delay-load IAT slots to generated thunks that push the import
+// index and jump to _pe_delay_resolve_internal:
+//
+//   common: push [rip + loader]     ; ff 35 disp32
+//           jmp [rip + resolver]    ; ff 25 disp32
+//           (padding)
+//   loader: .quad this
+//   resolver: .quad _pe_delay_resolve_internal
+//   thunk_i: push i                 ; 68 imm32
+//            jmp common             ; e9 rel32
+bool PE::bind_delay_lazy() {
+#if defined(QBDL_PE_DELAY_LAZY)
+  static constexpr size_t HEADER_SIZE = 32;
+  static constexpr size_t THUNK_SIZE = 16;
+  if (delay_imports_.empty()) {
+    return true;
+  }
+  const Arch binarch = arch();
+  if (binarch.arch != LIEF::ARCH_X86 || !binarch.is64) {
+    Logger::warn("Lazy delay-load binding is only supported on x86-64");
+    return false;
+  }
+  // The thunks jump to this process: the binary must run in it
+  if (!engine_->executes_on_host()) {
+    Logger::warn("Lazy delay-load binding needs an engine that executes the "
+                 "binary on the host");
+    return false;
+  }
+
+  std::vector<uint8_t> code(HEADER_SIZE + THUNK_SIZE * delay_imports_.size(),
+                            0xCC);
+  auto put = [&code](size_t offset, std::initializer_list<uint8_t> bytes) {
+    std::copy(std::begin(bytes), std::end(bytes), &code[offset]);
+  };
+  put(0, {0xFF, 0x35});
+  intmem::storeu_le<int32_t>(&code[2], 16 - 6);
+  put(6, {0xFF, 0x25});
+  intmem::storeu_le<int32_t>(&code[8], 24 - 12);
+  intmem::storeu_le<uint64_t>(&code[16], reinterpret_cast<uintptr_t>(this));
+  intmem::storeu_le<uint64_t>(
+      &code[24], reinterpret_cast<uintptr_t>(&_pe_delay_resolve_internal));
+  for (size_t idx = 0; idx < delay_imports_.size(); ++idx) {
+    const size_t thunk = HEADER_SIZE + idx * THUNK_SIZE;
+    put(thunk, {0x68});
+    intmem::storeu_le<uint32_t>(&code[thunk + 1], static_cast<uint32_t>(idx));
+    put(thunk + 5, {0xE9});
+    intmem::storeu_le<int32_t>(&code[thunk + 6],
+                               -static_cast<int32_t>(thunk + 10));
+  }
+
+  const size_t thunks_size = page_align(code.size());
+  const uint64_t thunks = engine_->mem().mmap(0, thunks_size);
+  if (thunks == 0) {
+    Logger::err("Unable to allocate delay-load thunks");
+    return false;
+  }
+  delay_thunks_ = thunks;
+  delay_thunks_size_ = thunks_size;
+  engine_->mem().write(thunks, code.data(), code.size());
+
+  for (size_t idx = 0; idx < delay_imports_.size(); ++idx) {
+    engine_->mem().write_ptr(binarch,
+                             base_address_ + delay_imports_[idx].iat_rva,
+                             thunks + HEADER_SIZE + idx * THUNK_SIZE);
+  }
+  return true;
+#else
+  Logger::warn("Lazy delay-load binding is not supported on this platform");
+  return false;
+#endif
+}
+
+std::string PE::read_string(uint64_t addr) {
+  std::string str;
+  const uint64_t end = base_address_ + mem_size_;
+  char c;
+  while (addr < end) {
+    engine_->mem().read(&c, addr++, 1);
+    if (c == '\0') {
+      break;
+    }
+    str.push_back(c);
+  }
+  return str;
+}
+
+std::vector<ImportSlot> PE::import_slots() const {
+  const Binary &binary = get_binary();
+  std::vector<ImportSlot> slots;
+  if (binary.has_imports()) {
+    for (const Import &imp : binary.imports()) {
+      for (const ImportEntry &entry : imp.entries()) {
+        // Slots are identified by name
+        if (entry.is_ordinal()) {
+          continue;
+        }
+        slots.push_back(
+            {entry.name(), base_address_ + entry.iat_address(), 0, true});
+      }
+    }
+  }
+  for (const DelayImport &imp : delay_imports_) {
+    if (!imp.by_ordinal) {
+      slots.push_back({imp.name, base_address_ + imp.iat_rva, 0, true});
+    }
+  }
+  return slots;
+}
+
+std::vector<FunctionSymbol> PE::function_symbols() const {
+  const Binary &binary = get_binary();
+  std::vector<FunctionSymbol> functions;
+  if (!binary.has_exports()) {
+    return functions;
+  }
+  for (const ExportEntry &entry : binary.get_export().entries()) {
+    // Forwarded exports are defined by another DLL
+    if (entry.is_extern() || entry.name().empty()) {
+      continue;
+    }
+    functions.push_back({entry.name(), base_address_ + entry.address(), 0});
+  }
+  return functions;
+}
+
+std::vector<ExportedSymbol> PE::exported_symbols() const {
+  const Binary &binary = get_binary();
+  std::vector<ExportedSymbol> exports;
+  if (!binary.has_exports()) {
+    return exports;
+  }
+  auto is_code = [&binary](uint64_t rva) {
+    for (const Section &section : binary.sections()) {
+      if (rva >= section.virtual_address() &&
+          rva < section.virtual_address() + section.virtual_size()) {
+        return section.has_characteristic(
+            SECTION_CHARACTERISTICS::IMAGE_SCN_MEM_EXECUTE);
+      }
+    }
+    return false;
+  };
+  for (const ExportEntry &entry : binary.get_export().entries()) {
+    // Forwarded exports are defined by another DLL
+    if (entry.is_extern() || entry.name().empty()) {
+      continue;
+    }
+    const ExportedSymbol::KIND kind = is_code(entry.address())
+                                          ? ExportedSymbol::KIND::FUNCTION
+                                          : ExportedSymbol::KIND::DATA;
+    exports.push_back({entry.name(), base_address_ + entry.address(), kind});
+  }
+  return exports;
 }
 
 Arch PE::arch() const { return Arch::from_bin(get_binary()); }
@@ -149,6 +526,11 @@ uint64_t PE::get_rva(const Binary &bin, uint64_t addr) const {
   return addr;
 }
 
-PE::~PE() = default;
+PE::~PE() {
+  stop_background_binding();
+  if (delay_thunks_ != 0) {
+    engine_->mem().munmap(delay_thunks_, delay_thunks_size_);
+  }
+}
 
 } // namespace QBDL::Loaders
@@ -0,0 +1,31 @@
+#include "base_relocations.hpp"
+#include "fixups.hpp"
+
+namespace QBDL {
+
+namespace {
+enum BASE_TYPE : uint8_t {
+  IMAGE_REL_BASED_ABSOLUTE = 0,
+  IMAGE_REL_BASED_HIGHLOW = 3,
+  IMAGE_REL_BASED_DIR64 = 10,
+};
+} // namespace
+
+bool push_base_relocation(FixupBatch &batch, uint8_t type, uint64_t addr,
+                          uint64_t delta) {
+  switch (type) {
+  case IMAGE_REL_BASED_ABSOLUTE:
+    // Padding
+    return true;
+  case IMAGE_REL_BASED_HIGHLOW:
+    batch.push(addr, delta, 4, FixupBatch::KIND::ADD);
+    return true;
+  case IMAGE_REL_BASED_DIR64:
+    batch.push(addr, delta, 8, FixupBatch::KIND::ADD);
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace QBDL
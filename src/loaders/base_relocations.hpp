@@ -0,0 +1,24 @@
+#ifndef QBDL_BASE_RELOCATIONS_H_
+#define QBDL_BASE_RELOCATIONS_H_
+
+#include <cstdint>
+
+namespace QBDL {
+
+class FixupBatch;
+
+/** Queues a PE base relocation entry into \p batch.
+ *
+ * @param[in,out] batch Fixups of the block (page) of the entry
+ * @param[in] type Type of the entry (`IMAGE_REL_BASED_*`)
+ * @param[in] addr Absolute address of the relocated value
+ * @param[in] delta Difference between the base address of the image and its
+ * preferred base address
+ * @returns false if \p type is not supported.
+ */
+bool push_base_relocation(FixupBatch &batch, uint8_t type, uint64_t addr,
+                          uint64_t delta);
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,294 @@
+#include "chained_fixups.hpp"
+#include "intmem.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace QBDL {
+
+namespace {
+// See <mach-o/fixup-chains.h>
+enum POINTER_FORMAT : uint16_t {
+  DYLD_CHAINED_PTR_ARM64E = 1,
+  DYLD_CHAINED_PTR_64 = 2,
+  DYLD_CHAINED_PTR_64_OFFSET = 6,
+  DYLD_CHAINED_PTR_ARM64E_USERLAND = 9,
+  DYLD_CHAINED_PTR_ARM64E_USERLAND24 = 12,
+};
+
+enum IMPORT_FORMAT : uint32_t {
+  DYLD_CHAINED_IMPORT = 1,
+  DYLD_CHAINED_IMPORT_ADDEND = 2,
+  DYLD_CHAINED_IMPORT_ADDEND64 = 3,
+};
+
+static constexpr uint16_t DYLD_CHAINED_PTR_START_NONE = 0xFFFF;
+static constexpr uint16_t DYLD_CHAINED_PTR_START_MULTI = 0x8000;
+
+// Offsets in dyld_chained_fixups_header
+static constexpr size_t HDR_VERSION = 0;
+static constexpr size_t HDR_STARTS_OFFSET = 4;
+static constexpr size_t HDR_IMPORTS_OFFSET = 8;
+static constexpr size_t HDR_SYMBOLS_OFFSET = 12;
+static constexpr size_t HDR_IMPORTS_COUNT = 16;
+static constexpr size_t HDR_IMPORTS_FORMAT = 20;
+static constexpr size_t HDR_SYMBOLS_FORMAT = 24;
+static constexpr size_t HDR_SIZE = 28;
+
+// Offsets in dyld_chained_starts_in_segment
+static constexpr size_t SEG_PAGE_SIZE = 4;
+static constexpr size_t SEG_POINTER_FORMAT = 6;
+static constexpr size_t SEG_SEGMENT_OFFSET = 8;
+static constexpr size_t SEG_PAGE_COUNT = 20;
+static constexpr size_t SEG_PAGE_START = 22;
+
+bool is_supported(uint16_t pointer_format) {
+  switch (pointer_format) {
+  case DYLD_CHAINED_PTR_ARM64E:
+  case DYLD_CHAINED_PTR_64:
+  case DYLD_CHAINED_PTR_64_OFFSET:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+  case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Special library ordinals (self, main executable, flat lookup, ...) are
+// small negative numbers stored in \p bits bits.
+int32_t library_ordinal(uint32_t value, unsigned bits) {
+  const uint32_t max = (1U << bits) - 1;
+  if (value > max - 0x10) {
+    return static_cast<int32_t>(value) - static_cast<int32_t>(max + 1);
+  }
+  return static_cast<int32_t>(value);
+}
+
+int64_t sign_extend(uint64_t value, unsigned bits) {
+  const uint64_t sign = 1ULL << (bits - 1);
+  return static_cast<int64_t>((value ^ sign) - sign);
+}
+} // namespace
+
+std::unique_ptr<ChainedFixups>
+ChainedFixups::parse(std::vector<uint8_t> data,
+                     std::vector<uint64_t> const &segments_size) {
+  const uint8_t *raw = data.data();
+  const size_t size = data.size();
+  auto in_bounds = [size](uint64_t offset, uint64_t len) {
+    return offset <= size && len <= size - offset;
+  };
+  auto u16 = [raw](size_t offset) {
+    return intmem::loadu_le<uint16_t>(raw + offset);
+  };
+  auto u32 = [raw](size_t offset) {
+    return intmem::loadu_le<uint32_t>(raw + offset);
+  };
+  auto u64 = [raw](size_t offset) {
+    return intmem::loadu_le<uint64_t>(raw + offset);
+  };
+
+  if (!in_bounds(0, HDR_SIZE) || u32(HDR_VERSION) != 0) {
+    Logger::err("Unsupported chained fixups header");
+    return {};
+  }
+  if (u32(HDR_SYMBOLS_FORMAT) != 0) {
+    Logger::err("Compressed chained fixups symbols are not supported");
+    return {};
+  }
+
+  std::unique_ptr<ChainedFixups> fixups{new ChainedFixups{}};
+
+  // Pages with fixups
+  // =======================================================
+  const uint32_t starts_offset = u32(HDR_STARTS_OFFSET);
+  if (!in_bounds(starts_offset, sizeof(uint32_t))) {
+    Logger::err("Chained fixups starts are out of bounds");
+    return {};
+  }
+  const uint32_t seg_count = u32(starts_offset);
+  if (!in_bounds(starts_offset + 4, uint64_t(seg_count) * 4)) {
+    Logger::err("Chained fixups starts are out of bounds");
+    return {};
+  }
+  for (uint32_t seg = 0; seg < seg_count; ++seg) {
+    const uint32_t seg_info_offset = u32(starts_offset + 4 + seg * 4);
+    if (seg_info_offset == 0) {
+      continue;
+    }
+    const uint64_t info = uint64_t(starts_offset) + seg_info_offset;
+    if (!in_bounds(info, SEG_PAGE_START)) {
+      Logger::err("Chained fixups of segment {} are out of bounds", seg);
+      return {};
+    }
+    const uint16_t page_size = u16(info + SEG_PAGE_SIZE);
+    const uint16_t pointer_format = u16(info + SEG_POINTER_FORMAT);
+    const uint64_t segment_offset = u64(info + SEG_SEGMENT_OFFSET);
+    const uint16_t page_count = u16(info + SEG_PAGE_COUNT);
+    if (!is_supported(pointer_format)) {
+      Logger::err("Chained fixups pointer format {} is not supported",
+                  pointer_format);
+      return {};
+    }
+    if (!in_bounds(info + SEG_PAGE_START, uint64_t(page_count) * 2)) {
+      Logger::err("Chained fixups of segment {} are out of bounds", seg);
+      return {};
+    }
+    const uint64_t seg_size =
+        seg < segments_size.size() ? segments_size[seg] : ~0ULL;
+    for (uint16_t page = 0; page < page_count; ++page) {
+      const uint16_t start = u16(info + SEG_PAGE_START + page * 2);
+      if (start == DYLD_CHAINED_PTR_START_NONE) {
+        continue;
+      }
+      if (start & DYLD_CHAINED_PTR_START_MULTI) {
+        // Only used by 32-bit formats
+        Logger::err("Multiple chains per page are not supported");
+        return {};
+      }
+      const uint64_t page_offset = uint64_t(page) * page_size;
+      const uint64_t page_len =
+          std::min<uint64_t>(page_size, seg_size - page_offset);
+      fixups->pages_.push_back({segment_offset + page_offset,
+                                static_cast<uint32_t>(page_len), start,
+                                pointer_format});
+    }
+  }
+
+  // Imports
+  // =======================================================
+  const uint32_t imports_offset = u32(HDR_IMPORTS_OFFSET);
+  const uint32_t symbols_offset = u32(HDR_SYMBOLS_OFFSET);
+  const uint32_t imports_count = u32(HDR_IMPORTS_COUNT);
+  const uint32_t imports_format = u32(HDR_IMPORTS_FORMAT);
+  size_t import_size = 0;
+  switch (imports_format) {
+  case DYLD_CHAINED_IMPORT:
+    import_size = 4;
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND:
+    import_size = 8;
+    break;
+  case DYLD_CHAINED_IMPORT_ADDEND64:
+    import_size = 16;
+    break;
+  default:
+    Logger::err("Chained fixups import format {} is not supported",
+                imports_format);
+    return {};
+  }
+  if (!in_bounds(imports_offset, uint64_t(imports_count) * import_size)) {
+    Logger::err("Chained fixups imports are out of bounds");
+    return {};
+  }
+  fixups->imports_.reserve(imports_count);
+  for (uint32_t idx = 0; idx < imports_count; ++idx) {
+    const size_t entry = imports_offset + idx * import_size;
+    Import import{};
+    uint64_t name_offset = 0;
+    if (imports_format == DYLD_CHAINED_IMPORT_ADDEND64) {
+      const uint64_t value = u64(entry);
+      import.library_ordinal = library_ordinal(value & 0xFFFF, 16);
+      import.weak = (value >> 16) & 1;
+      name_offset = value >> 32;
+      import.addend = static_cast<int64_t>(u64(entry + 8));
+    } else {
+      const uint32_t value = u32(entry);
+      import.library_ordinal = library_ordinal(value & 0xFF, 8);
+      import.weak = (value >> 8) & 1;
+      name_offset = value >> 9;
+      if (imports_format == DYLD_CHAINED_IMPORT_ADDEND) {
+        import.addend = static_cast<int32_t>(u32(entry + 4));
+      }
+    }
+    const uint64_t name = uint64_t(symbols_offset) + name_offset;
+    if (!in_bounds(name, 1)) {
+      Logger::err("Chained fixups import {} has an invalid name", idx);
+      return {};
+    }
+    const char *str = reinterpret_cast<const char *>(raw + name);
+    import.name = std::string_view{str, strnlen(str, size - name)};
+    fixups->imports_.push_back(import);
+  }
+
+  // Names point into data: keep it alive (moving a vector keeps its buffer)
+  fixups->data_ = std::move(data);
+  return fixups;
+}
+
+bool ChainedFixups::apply_page(Page const &page, uint8_t *content,
+                               uint64_t imagebase, uint64_t base_address,
+                               std::vector<Bind> &binds) const {
+  const bool arm64e = page.pointer_format != DYLD_CHAINED_PTR_64 &&
+                      page.pointer_format != DYLD_CHAINED_PTR_64_OFFSET;
+  // Rebase targets are either preferred addresses or offsets
+  const bool vmaddr_target = page.pointer_format == DYLD_CHAINED_PTR_64 ||
+                             page.pointer_format == DYLD_CHAINED_PTR_ARM64E;
+  const size_t stride = arm64e ? 8 : 4;
+
+  auto rebase = [&](uint64_t target, uint64_t high8) {
+    if (vmaddr_target && target >= imagebase) {
+      target -= imagebase;
+    }
+    return (base_address + target) | (high8 << 56);
+  };
+
+  uint64_t offset = page.start;
+  while (true) {
+    if (offset + sizeof(uint64_t) > page.size) {
+      Logger::err("Fixup chain out of page at 0x{:x}", page.rva + offset);
+      return false;
+    }
+    const uint64_t raw = intmem::loadu_le<uint64_t>(content + offset);
+    uint64_t value = 0;
+    uint64_t next;
+    bool bind;
+    uint32_t ordinal = 0;
+    int64_t addend = 0;
+    if (!arm64e) {
+      // dyld_chained_ptr_64_rebase / dyld_chained_ptr_64_bind
+      bind = raw >> 63;
+      next = (raw >> 51) & 0xFFF;
+      if (bind) {
+        ordinal = raw & 0xFFFFFF;
+        addend = (raw >> 24) & 0xFF;
+      } else {
+        value = rebase(raw & 0xFFFFFFFFFULL, (raw >> 36) & 0xFF);
+      }
+    } else {
+      // dyld_chained_ptr_arm64e_*
+      const bool auth = raw >> 63;
+      bind = (raw >> 62) & 1;
+      next = (raw >> 51) & 0x7FF;
+      if (bind) {
+        ordinal = page.pointer_format == DYLD_CHAINED_PTR_ARM64E_USERLAND24
+                      ? raw & 0xFFFFFF
+                      : raw & 0xFFFF;
+        if (!auth) {
+          addend = sign_extend((raw >> 32) & 0x7FFFF, 19);
+        }
+      } else if (auth) {
+        // Authenticated rebases always hold an offset
+        value = base_address + (raw & 0xFFFFFFFF);
+      } else {
+        value = rebase(raw & 0x7FFFFFFFFFFULL, (raw >> 43) & 0xFF);
+      }
+    }
+    if (bind) {
+      if (ordinal >= imports_.size()) {
+        Logger::err("Invalid import {} at 0x{:x}", ordinal, page.rva + offset);
+        return false;
+      }
+      binds.push_back({page.rva + offset, ordinal, addend});
+    }
+    intmem::storeu_le<uint64_t>(content + offset, value);
+    if (next == 0) {
+      return true;
+    }
+    offset += next * stride;
+  }
+}
+
+} // namespace QBDL
@@ -0,0 +1,84 @@
+#ifndef QBDL_CHAINED_FIXUPS_H_
+#define QBDL_CHAINED_FIXUPS_H_
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace QBDL {
+
+/** Mach-O chained fixups, as described by the `LC_DYLD_CHAINED_FIXUPS` load
+ * command (see `<mach-o/fixup-chains.h>`).
+ *
+ * Fixups are stored in the pointers themselves: each page holds one chain of
+ * rebases and binds. Pages are independent from each others, so that they
+ * can be processed in any order, or concurrently.
+ *
+ * Only the 64-bit pointer formats are supported:
+ * `DYLD_CHAINED_PTR_64`, `DYLD_CHAINED_PTR_64_OFFSET`,
+ * `DYLD_CHAINED_PTR_ARM64E`, `DYLD_CHAINED_PTR_ARM64E_USERLAND` and
+ * `DYLD_CHAINED_PTR_ARM64E_USERLAND24`. Authenticated pointers are written
+ * without their signature.
+ */
+class ChainedFixups {
+public:
+  struct Import {
+    std::string_view name;
+    int32_t library_ordinal;
+    bool weak;
+    int64_t addend;
+  };
+
+  /** A page holding a chain of fixups */
+  struct Page {
+    uint64_t rva;
+    uint32_t size;
+    uint16_t start;
+    uint16_t pointer_format;
+  };
+
+  /** A bind found while walking a page, to be resolved later */
+  struct Bind {
+    uint64_t rva;
+    uint32_t import;
+    int64_t addend;
+  };
+
+  /** Parses the content of the `LC_DYLD_CHAINED_FIXUPS` payload.
+   *
+   * @param[in] data Payload, copied from `__LINKEDIT`
+   * @param[in] segments_size Virtual size of each segment, in the order of
+   * the load commands, used to bound the last page of each segment
+   * @returns nullptr if \p data is malformed or uses an unsupported format.
+   */
+  static std::unique_ptr<ChainedFixups>
+  parse(std::vector<uint8_t> data, std::vector<uint64_t> const &segments_size);
+
+  const std::vector<Page> &pages() const { return pages_; }
+  const std::vector<Import> &imports() const { return imports_; }
+
+  /** Walks the chain of \p page.
+   *
+   * Rebases are applied in place and binds are cleared and appended to
+   * \p binds.
+   *
+   * @param[in] page Page to process
+   * @param[in,out] content Content of the page, as mapped in memory
+   * @param[in] imagebase Preferred base address of the binary
+   * @param[in] base_address Base address the binary is mapped at
+   * @param[out] binds Binds found in the page
+   * @returns false if the chain is malformed.
+   */
+  bool apply_page(Page const &page, uint8_t *content, uint64_t imagebase,
+                  uint64_t base_address, std::vector<Bind> &binds) const;
+
+private:
+  std::vector<uint8_t> data_;
+  std::vector<Page> pages_;
+  std::vector<Import> imports_;
+};
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,61 @@
+#include "fat_header.hpp"
+#include "intmem.hpp"
+
+namespace QBDL {
+
+namespace {
+constexpr uint32_t FAT_MAGIC = 0xcafebabe;
+constexpr uint32_t FAT_MAGIC_64 = 0xcafebabf;
+// Java class files share FAT_MAGIC, but have a big version number here
+constexpr uint32_t MAX_FAT_ARCH = 64;
+constexpr size_t HEADER_SIZE = 8;
+
+// fat_arch: cputype, cpusubtype, offset, size, align (32-bit fields)
+// fat_arch_64: same with 64-bit offset and size, plus a reserved field
+size_t entry_size(uint32_t magic) { return magic == FAT_MAGIC_64 ? 32 : 20; }
+} // namespace
+
+size_t fat_header_size(const uint8_t *header) {
+  const uint32_t magic = intmem::loadu_be<uint32_t>(&header[0]);
+  const uint32_t nfat_arch = intmem::loadu_be<uint32_t>(&header[4]);
+  if ((magic != FAT_MAGIC && magic != FAT_MAGIC_64) ||
+      nfat_arch > MAX_FAT_ARCH) {
+    return 0;
+  }
+  return HEADER_SIZE + entry_size(magic) * nfat_arch;
+}
+
+std::vector<FatSlice> fat_slices(const uint8_t *header) {
+  const uint32_t magic = intmem::loadu_be<uint32_t>(&header[0]);
+  const uint32_t nfat_arch = intmem::loadu_be<uint32_t>(&header[4]);
+  const bool is64 = magic == FAT_MAGIC_64;
+  std::vector<FatSlice> slices;
+  slices.reserve(nfat_arch);
+  for (uint32_t idx = 0; idx < nfat_arch; ++idx) {
+    const uint8_t *entry = header + HEADER_SIZE + idx * entry_size(magic);
+    slices.push_back({intmem::loadu_be<uint32_t>(entry),
+                      is64 ? intmem::loadu_be<uint64_t>(entry + 8)
+                           : intmem::loadu_be<uint32_t>(entry + 8),
+                      is64 ? intmem::loadu_be<uint64_t>(entry + 16)
+                           : intmem::loadu_be<uint32_t>(entry + 12)});
+  }
+  return slices;
+}
+
+std::optional<Arch> fat_arch(uint32_t cputype) {
+  static constexpr uint32_t CPU_ARCH_ABI64 = 0x01000000;
+  const bool is64 = cputype & CPU_ARCH_ABI64;
+  switch (cputype & ~CPU_ARCH_ABI64) {
+  case 7: // CPU_TYPE_X86
+    return Arch{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, is64};
+  case 12: // CPU_TYPE_ARM
+    return Arch{is64 ? LIEF::ARCH_ARM64 : LIEF::ARCH_ARM, LIEF::ENDIAN_LITTLE,
+                is64};
+  case 18: // CPU_TYPE_POWERPC
+    return Arch{LIEF::ARCH_PPC, LIEF::ENDIAN_BIG, is64};
+  default:
+    return {};
+  }
+}
+
+} // namespace QBDL
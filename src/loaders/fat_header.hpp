@@ -0,0 +1,40 @@
+#ifndef QBDL_FAT_HEADER_H_
+#define QBDL_FAT_HEADER_H_
+
+#include <QBDL/arch.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace QBDL {
+
+/** A slice of a universal Mach-O file, from its `fat_arch` or `fat_arch_64`
+ * entry */
+struct FatSlice {
+  uint32_t cputype;
+  uint64_t offset;
+  uint64_t size;
+};
+
+/** Size of the header of a universal Mach-O file, entries included.
+ *
+ * @param[in] header The first 8 bytes of the file (magic and number of
+ * entries)
+ * @returns 0 if \p header is not the header of a universal Mach-O file.
+ */
+size_t fat_header_size(const uint8_t *header);
+
+/** Lists the slices of a universal Mach-O file.
+ *
+ * @param[in] header The header of the file, of fat_header_size() bytes
+ */
+std::vector<FatSlice> fat_slices(const uint8_t *header);
+
+/** Architecture of a `cputype` of a universal Mach-O file, if known */
+std::optional<Arch> fat_arch(uint32_t cputype);
+
+} // namespace QBDL
+
+#endif
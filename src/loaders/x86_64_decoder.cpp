@@ -0,0 +1,374 @@
+#include "x86_64_decoder.hpp"
+
+namespace QBDL::x86_64 {
+
+namespace {
+constexpr size_t MAX_LENGTH = 15;
+
+// Size of a `z` immediate (16 or 32 bits), that depends on the operand size
+size_t imm_z(bool opsize, bool rex_w) { return opsize && !rex_w ? 2 : 4; }
+
+// Length of a ModRM byte and of the SIB byte and displacement it implies.
+// Returns 0 if the bytes are missing.
+size_t modrm_length(const uint8_t *code, size_t size) {
+  if (size < 1) {
+    return 0;
+  }
+  const uint8_t mod = code[0] >> 6;
+  const uint8_t rm = code[0] & 7;
+  if (mod == 3) {
+    return 1;
+  }
+  size_t len = 1;
+  if (rm == 4) {
+    if (size < 2) {
+      return 0;
+    }
+    len += 1;
+    // No base register: disp32
+    if (mod == 0 && (code[1] & 7) == 5) {
+      len += 4;
+    }
+  } else if (mod == 0 && rm == 5) {
+    len += 4; // RIP-relative
+  }
+  if (mod == 1) {
+    len += 1;
+  } else if (mod == 2) {
+    len += 4;
+  }
+  return len <= size ? len : 0;
+}
+
+// Immediate size of the instructions of the 0F map that take one
+bool has_imm8_0f(uint8_t opcode) {
+  return (opcode >= 0x70 && opcode <= 0x73) || opcode == 0xa4 ||
+         opcode == 0xac || opcode == 0xba || opcode == 0xc2 ||
+         (opcode >= 0xc4 && opcode <= 0xc6);
+}
+
+// Instructions of the 0F map without a ModRM byte
+bool no_modrm_0f(uint8_t opcode) {
+  switch (opcode) {
+  case 0x05: // syscall
+  case 0x06: // clts
+  case 0x07: // sysret
+  case 0x08: // invd
+  case 0x09: // wbinvd
+  case 0x0b: // ud2
+  case 0x0e: // femms
+  case 0x77: // emms
+  case 0xa0: // push %fs
+  case 0xa1: // pop %fs
+  case 0xa2: // cpuid
+  case 0xa8: // push %gs
+  case 0xa9: // pop %gs
+  case 0xaa: // rsm
+    return true;
+  default:
+    return (opcode >= 0x30 && opcode <= 0x37) || // wrmsr ... getsec
+           (opcode >= 0x80 && opcode <= 0x8f) || // jcc rel32
+           (opcode >= 0xc8 && opcode <= 0xcf);   // bswap
+  }
+}
+
+// VEX and EVEX encoded instructions: \p map is the opcode map (1: 0F,
+// 2: 0F38, 3: 0F3A, 5 and 6: EVEX FP16 maps). \p code points to the opcode.
+size_t vex_length(const uint8_t *code, size_t size, uint8_t map) {
+  if (size < 1) {
+    return 0;
+  }
+  const uint8_t opcode = code[0];
+  // vzeroupper / vzeroall
+  if (map == 1 && opcode == 0x77) {
+    return 1;
+  }
+  const size_t modrm = modrm_length(code + 1, size - 1);
+  if (modrm == 0) {
+    return 0;
+  }
+  size_t len = 1 + modrm;
+  if (map == 3 || (map == 1 && has_imm8_0f(opcode))) {
+    len += 1;
+  }
+  return len <= size ? len : 0;
+}
+} // namespace
+
+size_t insn_length(const uint8_t *code, size_t size) {
+  if (size > MAX_LENGTH) {
+    size = MAX_LENGTH;
+  }
+  size_t pos = 0;
+  bool opsize = false;
+  bool addrsize = false;
+  bool rep = false;
+
+  // Legacy prefixes
+  for (; pos < size; ++pos) {
+    const uint8_t byte = code[pos];
+    if (byte == 0x66) {
+      opsize = true;
+    } else if (byte == 0x67) {
+      addrsize = true;
+    } else if (byte == 0xf2 || byte == 0xf3) {
+      rep = true;
+    } else if (byte != 0xf0 && byte != 0x2e && byte != 0x36 && byte != 0x3e &&
+               byte != 0x26 && byte != 0x64 && byte != 0x65) {
+      break;
+    }
+  }
+  bool rex_w = false;
+  if (pos < size && (code[pos] & 0xf0) == 0x40) {
+    rex_w = (code[pos] & 0x08) != 0;
+    ++pos;
+  }
+  if (pos >= size) {
+    return 0;
+  }
+
+  const uint8_t opcode = code[pos++];
+  const uint8_t *rest = code + pos;
+  const size_t left = size - pos;
+  size_t len = 0;
+  auto with_modrm = [&](size_t imm) -> size_t {
+    const size_t modrm = modrm_length(rest, left);
+    if (modrm == 0 || modrm + imm > left) {
+      return 0;
+    }
+    return pos + modrm + imm;
+  };
+  auto with_imm = [&](size_t imm) -> size_t {
+    return imm <= left ? pos + imm : 0;
+  };
+
+  // VEX and EVEX prefixes (always, in 64-bit mode)
+  if (opcode == 0xc5) {
+    if (left < 1) {
+      return 0;
+    }
+    len = vex_length(rest + 1, left - 1, 1);
+    return len != 0 ? pos + 1 + len : 0;
+  }
+  if (opcode == 0xc4) {
+    if (left < 2) {
+      return 0;
+    }
+    const uint8_t map = rest[0] & 0x1f;
+    if (map < 1 || map > 3) {
+      return 0;
+    }
+    len = vex_length(rest + 2, left - 2, map);
+    return len != 0 ? pos + 2 + len : 0;
+  }
+  if (opcode == 0x62) {
+    if (left < 3) {
+      return 0;
+    }
+    const uint8_t map = rest[0] & 0x07;
+    if (map == 0 || map == 4 || map == 7) {
+      return 0;
+    }
+    len = vex_length(rest + 3, left - 3, map);
+    return len != 0 ? pos + 3 + len : 0;
+  }
+  // XOP shares its first byte with pop r/m
+  if (opcode == 0x8f && left >= 1 && (rest[0] & 0x1f) >= 8) {
+    return 0;
+  }
+
+  if (opcode == 0x0f) {
+    if (left < 1) {
+      return 0;
+    }
+    const uint8_t op2 = rest[0];
+    ++pos;
+    ++rest;
+    const size_t left2 = left - 1;
+    auto with_modrm2 = [&](size_t imm) -> size_t {
+      const size_t modrm = modrm_length(rest, left2);
+      if (modrm == 0 || modrm + imm > left2) {
+        return 0;
+      }
+      return pos + modrm + imm;
+    };
+    if (op2 == 0x38 || op2 == 0x3a) {
+      if (left2 < 1) {
+        return 0;
+      }
+      ++pos;
+      ++rest;
+      const size_t modrm = modrm_length(rest, left2 - 1);
+      const size_t imm = op2 == 0x3a ? 1 : 0;
+      if (modrm == 0 || modrm + imm > left2 - 1) {
+        return 0;
+      }
+      return pos + modrm + imm;
+    }
+    // 3DNow!, and SSE4a extrq/insertq with immediates
+    if (op2 == 0x0f || ((op2 == 0x78 || op2 == 0x79) && (opsize || rep))) {
+      return 0;
+    }
+    if (op2 >= 0x80 && op2 <= 0x8f) {
+      return 4 <= left2 ? pos + 4 : 0;
+    }
+    if (no_modrm_0f(op2)) {
+      return pos;
+    }
+    return with_modrm2(has_imm8_0f(op2) ? 1 : 0);
+  }
+
+  const size_t immz = imm_z(opsize, rex_w);
+  if (opcode < 0x40) {
+    switch (opcode & 7) {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+      return with_modrm(0);
+    case 4:
+      return with_imm(1);
+    case 5:
+      return with_imm(immz);
+    default:
+      // push/pop of segment registers, BCD adjustments: invalid
+      return 0;
+    }
+  }
+  if (opcode >= 0x50 && opcode <= 0x5f) {
+    return pos;
+  }
+  if (opcode >= 0x70 && opcode <= 0x7f) {
+    return with_imm(1); // jcc rel8
+  }
+  if (opcode >= 0x84 && opcode <= 0x8f) {
+    return with_modrm(0);
+  }
+  if (opcode >= 0x90 && opcode <= 0x9f) {
+    return opcode == 0x9a ? 0 : pos;
+  }
+  if (opcode >= 0xb0 && opcode <= 0xb7) {
+    return with_imm(1);
+  }
+  if (opcode >= 0xb8 && opcode <= 0xbf) {
+    return with_imm(rex_w ? 8 : immz);
+  }
+  if (opcode >= 0xd8 && opcode <= 0xdf) {
+    return with_modrm(0); // x87
+  }
+
+  switch (opcode) {
+  case 0x63: // movsxd
+    return with_modrm(0);
+  case 0x68: // push imm
+    return with_imm(immz);
+  case 0x69: // imul imm
+    return with_modrm(immz);
+  case 0x6a:
+    return with_imm(1);
+  case 0x6b:
+    return with_modrm(1);
+  case 0x6c:
+  case 0x6d:
+  case 0x6e:
+  case 0x6f:
+    return pos;
+  case 0x80:
+  case 0x83:
+    return with_modrm(1);
+  case 0x81:
+    return with_modrm(immz);
+  case 0xa0:
+  case 0xa1:
+  case 0xa2:
+  case 0xa3: // mov moffs
+    return with_imm(addrsize ? 4 : 8);
+  case 0xa4:
+  case 0xa5:
+  case 0xa6:
+  case 0xa7:
+  case 0xaa:
+  case 0xab:
+  case 0xac:
+  case 0xad:
+  case 0xae:
+  case 0xaf:
+    return pos;
+  case 0xa8:
+    return with_imm(1);
+  case 0xa9:
+    return with_imm(immz);
+  case 0xc0:
+  case 0xc1:
+  case 0xc6:
+    return with_modrm(1);
+  case 0xc7:
+    return with_modrm(immz);
+  case 0xc2:
+  case 0xca:
+    return with_imm(2);
+  case 0xc8: // enter
+    return with_imm(3);
+  case 0xc3:
+  case 0xc9:
+  case 0xcb:
+  case 0xcc:
+  case 0xcf:
+    return pos;
+  case 0xcd:
+    return with_imm(1);
+  case 0xd0:
+  case 0xd1:
+  case 0xd2:
+  case 0xd3:
+    return with_modrm(0);
+  case 0xd7:
+    return pos;
+  case 0xe0:
+  case 0xe1:
+  case 0xe2:
+  case 0xe3:
+  case 0xe4:
+  case 0xe5:
+  case 0xe6:
+  case 0xe7:
+  case 0xeb:
+    return with_imm(1);
+  case 0xe8:
+  case 0xe9: // call/jmp rel32
+    return with_imm(4);
+  case 0xec:
+  case 0xed:
+  case 0xee:
+  case 0xef:
+  case 0xf1:
+  case 0xf4:
+  case 0xf5:
+  case 0xf8:
+  case 0xf9:
+  case 0xfa:
+  case 0xfb:
+  case 0xfc:
+  case 0xfd:
+    return pos;
+  case 0xf6:
+  case 0xf7: {
+    // Only test has an immediate
+    if (left < 1) {
+      return 0;
+    }
+    const uint8_t reg = (rest[0] >> 3) & 7;
+    if (reg > 1) {
+      return with_modrm(0);
+    }
+    return with_modrm(opcode == 0xf6 ? 1 : immz);
+  }
+  case 0xfe:
+  case 0xff:
+    return with_modrm(0);
+  default:
+    return 0;
+  }
+}
+
+} // namespace QBDL::x86_64
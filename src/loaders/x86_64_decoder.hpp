@@ -0,0 +1,24 @@
+#ifndef QBDL_X86_64_DECODER_H_
+#define QBDL_X86_64_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace QBDL::x86_64 {
+
+/** Computes the length of the 64-bit mode instruction at \p code.
+ *
+ * Only the length is decoded: legacy and REX prefixes, VEX and EVEX
+ * encodings, the one, two and three-byte opcode maps, ModRM, SIB,
+ * displacements and immediates.
+ *
+ * @param[in] code Bytes of the instruction
+ * @param[in] size Number of readable bytes at \p code
+ * @returns 0 if the instruction is invalid in 64-bit mode, is not supported
+ * (3DNow!, XOP, SSE4a immediates), or is truncated.
+ */
+size_t insn_length(const uint8_t *code, size_t size);
+
+} // namespace QBDL::x86_64
+
+#endif
@@ -1,13 +1,69 @@
 #include "logging.hpp"
+#include "spdlog/async.h"
+#include "spdlog/sinks/base_sink.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 
+#include <mutex>
+
 namespace QBDL {
 
+namespace {
+// Forwards the messages to a user-provided handler
+class HandlerSink final : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  HandlerSink(LogHandler handler) : handler_(std::move(handler)) {}
+
+protected:
+  void sink_it_(const spdlog::details::log_msg &msg) override {
+    handler_(static_cast<LogLevel>(msg.level),
+             std::string_view{msg.payload.data(), msg.payload.size()});
+  }
+  void flush_() override {}
+
+private:
+  LogHandler handler_;
+};
+} // namespace
+
 Logger::Logger(void) {
-  sink_ = spdlog::stdout_color_mt("qbdl");
-  sink_->set_level(spdlog::level::trace);
-  sink_->set_pattern("%v");
-  sink_->flush_on(spdlog::level::trace);
+  dist_ = std::make_shared<spdlog::sinks::dist_sink_mt>();
+  dist_->add_sink(std::make_shared<spdlog::sinks::stdout_color_sink_mt>());
+  make_logger(0);
+}
+
+// Not registered in spdlog's registry, so that it does not clash with the
+// loggers of the host application.
+void Logger::make_logger(size_t queue_size) {
+  // An asynchronous logger needs its thread pool: both are released with the
+  // last reference to the logger, and destroying the pool waits for its
+  // queue to be drained.
+  struct AsyncLogger {
+    std::shared_ptr<spdlog::details::thread_pool> pool;
+    std::shared_ptr<spdlog::logger> logger;
+  };
+  std::shared_ptr<spdlog::logger> logger;
+  if (queue_size == 0) {
+    logger = std::make_shared<spdlog::logger>("qbdl", dist_);
+  } else {
+    // Messages are formatted and written by a single thread. When the queue
+    // is full, the oldest messages are dropped instead of blocking.
+    auto async = std::make_shared<AsyncLogger>();
+    async->pool = std::make_shared<spdlog::details::thread_pool>(queue_size, 1);
+    async->logger = std::make_shared<spdlog::async_logger>(
+        "qbdl", dist_, async->pool,
+        spdlog::async_overflow_policy::overrun_oldest);
+    logger = std::shared_ptr<spdlog::logger>{async, async->logger.get()};
+  }
+  logger->set_level(static_cast<spdlog::level::level_enum>(level_.load()));
+  logger->set_pattern("%v");
+  // Errors are not lost if the process crashes right after them
+  logger->flush_on(spdlog::level::warn);
+
+  std::shared_ptr<spdlog::logger> previous =
+      std::atomic_exchange(&sink_, std::move(logger));
+  if (previous) {
+    previous->flush();
+  }
 }
 
 void Logger::setLogLevel(LogLevel level) {
@@ -26,18 +82,39 @@ void Logger::setLogLevel(LogLevel level) {
     LLMAP(critical, critical)
 #undef LLMAP
   }
-  sink_->set_level(slevel);
+  level_.store(level, std::memory_order_relaxed);
+  sink()->set_level(slevel);
 }
 
-static std::unique_ptr<Logger> logger_instance_;
+void Logger::setHandler(LogHandler handler) {
+  if (handler) {
+    dist_->set_sinks({std::make_shared<HandlerSink>(std::move(handler))});
+  } else {
+    dist_->set_sinks(
+        {std::make_shared<spdlog::sinks::stdout_color_sink_mt>()});
+  }
+  // The pattern is only applied to the sinks already there
+  dist_->set_pattern("%v");
+}
+
+void Logger::setAsync(size_t queue_size) { make_logger(queue_size); }
+
+void Logger::flush() { sink()->flush(); }
 
 Logger &Logger::instance() {
-  if (!logger_instance_) {
-    logger_instance_.reset(new Logger{});
-  }
-  return *logger_instance_;
+  // Function-local static: loaders can be driven from several threads.
+  static Logger logger_instance_;
+  return logger_instance_;
 }
 
 void setLogLevel(LogLevel level) { Logger::instance().setLogLevel(level); }
 
+void setLogHandler(LogHandler handler) {
+  Logger::instance().setHandler(std::move(handler));
+}
+
+void setLogAsync(size_t queue_size) { Logger::instance().setAsync(queue_size); }
+
+void flushLog() { Logger::instance().flush(); }
+
 } // namespace QBDL
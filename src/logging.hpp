@@ -1,19 +1,42 @@
 #ifndef QBDL_LOGGING_H_
 #define QBDL_LOGGING_H_
 
+#include "spdlog/sinks/dist_sink.h"
 #include "spdlog/spdlog.h"
 #include <QBDL/log.hpp>
 
-#ifndef NDEBUG
-static constexpr bool QBDL_DEBUG_ENABLED = false;
+#include <atomic>
+#include <memory>
+
+// Messages below this level are compiled out. It defaults to debug, and to
+// info when NDEBUG is defined.
+#ifndef QBDL_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define QBDL_MIN_LOG_LEVEL info
 #else
-static constexpr bool QBDL_DEBUG_ENABLED = true;
+#define QBDL_MIN_LOG_LEVEL debug
+#endif
 #endif
 
-#define QBDL_DEBUG(...) QBDL::Logger::debug(__VA_ARGS__)
-#define QBDL_INFO(...) QBDL::Logger::info(__VA_ARGS__)
-#define QBDL_ERROR(...) QBDL::Logger::err(__VA_ARGS__)
-#define QBDL_WARN(...) QBDL::Logger::warn(__VA_ARGS__)
+static constexpr QBDL::LogLevel QBDL_MIN_LEVEL =
+    QBDL::LogLevel::QBDL_MIN_LOG_LEVEL;
+static constexpr bool QBDL_DEBUG_ENABLED = QBDL_MIN_LEVEL <= QBDL::debug;
+
+// Unlike QBDL::Logger's functions, these macros do not evaluate their
+// arguments when the message is filtered out.
+#define QBDL_LOG(level, method, ...)                                           \
+  do {                                                                         \
+    if constexpr (QBDL::LogLevel::level >= QBDL_MIN_LEVEL) {                   \
+      if (QBDL::Logger::enabled(QBDL::LogLevel::level)) {                      \
+        QBDL::Logger::method(__VA_ARGS__);                                     \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define QBDL_DEBUG(...) QBDL_LOG(debug, debug, __VA_ARGS__)
+#define QBDL_INFO(...) QBDL_LOG(info, info, __VA_ARGS__)
+#define QBDL_ERROR(...) QBDL_LOG(err, err, __VA_ARGS__)
+#define QBDL_WARN(...) QBDL_LOG(warn, warn, __VA_ARGS__)
 
 namespace QBDL {
 class Logger {
@@ -21,27 +44,42 @@ public:
   static Logger &instance();
 
   void setLogLevel(LogLevel level);
+  void setHandler(LogHandler handler);
+  void setAsync(size_t queue_size);
+  void flush();
+
+  /** Tells whether messages of \p level are currently output */
+  static bool enabled(LogLevel level) {
+    return level >= QBDL_MIN_LEVEL &&
+           level >= Logger::instance().level_.load(std::memory_order_relaxed);
+  }
 
   template <typename... Args>
   static void debug(const char *fmt, const Args &...args) {
     if constexpr (QBDL_DEBUG_ENABLED) {
-      Logger::instance().sink_->debug(fmt, args...);
+      Logger::instance().sink()->debug(fmt, args...);
     }
   }
 
   template <typename... Args>
   static void info(const char *fmt, const Args &...args) {
-    Logger::instance().sink_->info(fmt, args...);
+    if constexpr (QBDL_MIN_LEVEL <= LogLevel::info) {
+      Logger::instance().sink()->info(fmt, args...);
+    }
   }
 
   template <typename... Args>
   static void err(const char *fmt, const Args &...args) {
-    Logger::instance().sink_->error(fmt, args...);
+    if constexpr (QBDL_MIN_LEVEL <= LogLevel::err) {
+      Logger::instance().sink()->error(fmt, args...);
+    }
   }
 
   template <typename... Args>
   static void warn(const char *fmt, const Args &...args) {
-    Logger::instance().sink_->warn(fmt, args...);
+    if constexpr (QBDL_MIN_LEVEL <= LogLevel::warn) {
+      Logger::instance().sink()->warn(fmt, args...);
+    }
   }
 
 private:
@@ -49,7 +87,17 @@ private:
   Logger(const Logger &) = delete;
   Logger &operator=(const Logger &) = delete;
 
+  void make_logger(size_t queue_size);
+
+  // The logger can be replaced by setAsync while other threads use it: they
+  // keep their own reference for the duration of a call.
+  std::shared_ptr<spdlog::logger> sink() const {
+    return std::atomic_load(&sink_);
+  }
+
+  std::shared_ptr<spdlog::sinks::dist_sink_mt> dist_;
   std::shared_ptr<spdlog::logger> sink_;
+  std::atomic<LogLevel> level_{LogLevel::trace};
 };
 
 } // namespace QBDL
@@ -0,0 +1,63 @@
+#ifndef QBDL_PARALLEL_H_
+#define QBDL_PARALLEL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Minimum number of items per worker thread: below this, spawning threads
+// costs more than it saves.
+#ifndef QBDL_PARALLEL_GRAIN
+#define QBDL_PARALLEL_GRAIN 256
+#endif
+
+namespace QBDL {
+
+/** Calls \p fn with every index in [0, \p count).
+ *
+ * If \p concurrent is true and there is enough work, indexes are handed out
+ * in chunks of consecutive indexes to worker threads and to the calling
+ * thread, so that \p fn must be thread-safe. Otherwise, \p fn is called in
+ * order from the calling thread. Returns once every call has returned.
+ */
+template <class F> void parallel_for(size_t count, bool concurrent, F &&fn) {
+  static constexpr size_t CHUNK = 64;
+  const size_t hw = std::max(std::thread::hardware_concurrency(), 1U);
+  const size_t nthreads =
+      concurrent ? std::min(hw, count / QBDL_PARALLEL_GRAIN) : 0;
+  if (nthreads <= 1) {
+    for (size_t idx = 0; idx < count; ++idx) {
+      fn(idx);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  auto worker = [&] {
+    while (true) {
+      const size_t begin = next.fetch_add(CHUNK, std::memory_order_relaxed);
+      if (begin >= count) {
+        return;
+      }
+      const size_t end = std::min(begin + CHUNK, count);
+      for (size_t idx = begin; idx < end; ++idx) {
+        fn(idx);
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads - 1);
+  for (size_t i = 1; i < nthreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace QBDL
+
+#endif
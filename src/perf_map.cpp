@@ -0,0 +1,69 @@
+#include "perf_map.hpp"
+#include "logging.hpp"
+#include "symbol_index.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace QBDL {
+
+namespace {
+std::atomic<bool> enabled{false};
+} // namespace
+
+void setPerfMapEnabled(bool value) {
+#if defined(__linux__)
+  enabled.store(value, std::memory_order_relaxed);
+#else
+  if (value) {
+    Logger::warn("Perf maps are not supported on this host");
+  }
+#endif
+}
+
+bool perf_map_enabled() { return enabled.load(std::memory_order_relaxed); }
+
+void perf_map_write(std::vector<FunctionSymbol> functions,
+                    uint64_t image_end) {
+#if defined(__linux__)
+  sort_functions(functions, image_end);
+
+  std::string content;
+  char line[64];
+  for (const FunctionSymbol &func : functions) {
+    if (func.name.empty() || func.address >= image_end) {
+      continue;
+    }
+    snprintf(line, sizeof(line), "%llx %llx ",
+             static_cast<unsigned long long>(func.address),
+             static_cast<unsigned long long>(func.size));
+    content += line;
+    content += func.name;
+    content += '\n';
+  }
+
+  // Several loaders can finish at the same time: write each image at once
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  const std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+  FILE *file = fopen(path.c_str(), "a");
+  if (file == nullptr) {
+    Logger::err("Unable to write the perf map {}", path);
+    return;
+  }
+  fwrite(content.data(), 1, content.size(), file);
+  fclose(file);
+  QBDL_DEBUG("Perf map: {} functions", functions.size());
+#else
+  (void)functions;
+  (void)image_end;
+#endif
+}
+
+} // namespace QBDL
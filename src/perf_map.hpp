@@ -0,0 +1,23 @@
+#ifndef QBDL_PERF_MAP_INTERNAL_H_
+#define QBDL_PERF_MAP_INTERNAL_H_
+
+#include <QBDL/Loader.hpp>
+#include <QBDL/perf_map.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace QBDL {
+
+bool perf_map_enabled();
+
+/** Appends \p functions to the perf map of the current process.
+ *
+ * Functions without a size extend to the next function, or to \p image_end
+ * for the last one.
+ */
+void perf_map_write(std::vector<FunctionSymbol> functions, uint64_t image_end);
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef QBDL_PROBES_H_
+#define QBDL_PROBES_H_
+
+#include <cstdint>
+
+/* USDT (SystemTap/DTrace-style) static probes, for bpftrace, perf or
+ * SystemTap, e.g.:
+ *
+ *   bpftrace -e 'usdt:libQBDL.so:qbdl:lazy_bind { print(str(arg0)); }'
+ *
+ * Each probe is a single nop, described in a `.note.stapsdt` ELF note with
+ * the location of its arguments, in the same format as <sys/sdt.h> (which is
+ * not required). Tracers replace the nop by a breakpoint when they attach.
+ * Arguments are passed as 64-bit values: strings are NUL-terminated
+ * pointers.
+ *
+ * Probes are only available on 64-bit Linux targets, and can be disabled
+ * with QBDL_NO_PROBES. They must not be used in inline functions.
+ */
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__)) &&     \
+    !defined(QBDL_NO_PROBES)
+
+#define QBDL_PROBE_ARG(x) ((uint64_t)(x))
+
+#define QBDL_PROBE_ASM(name, args)                                             \
+  "990: nop\n"                                                                 \
+  ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                \
+  ".balign 4\n"                                                                \
+  ".4byte 992f-991f, 994f-993f, 3\n"                                           \
+  "991: .asciz \"stapsdt\"\n"                                                  \
+  "992: .balign 4\n"                                                           \
+  "993: .8byte 990b\n"                                                         \
+  ".8byte _.stapsdt.base\n"                                                    \
+  ".8byte 0\n"                                                                 \
+  ".asciz \"qbdl\"\n"                                                          \
+  ".asciz \"" #name "\"\n"                                                     \
+  ".asciz \"" args "\"\n"                                                      \
+  "994: .balign 4\n"                                                           \
+  ".popsection\n"                                                              \
+  ".ifndef _.stapsdt.base\n"                                                   \
+  ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"     \
+  ".weak _.stapsdt.base\n"                                                     \
+  ".hidden _.stapsdt.base\n"                                                   \
+  "_.stapsdt.base: .space 1\n"                                                 \
+  ".size _.stapsdt.base, 1\n"                                                  \
+  ".popsection\n"                                                              \
+  ".endif\n"
+
+#define QBDL_PROBE0(name) __asm__ __volatile__(QBDL_PROBE_ASM(name, "") : :)
+#define QBDL_PROBE1(name, a0)                                                  \
+  __asm__ __volatile__(QBDL_PROBE_ASM(name, "8@%[p0]")                         \
+                       :                                                       \
+                       : [p0] "r"(QBDL_PROBE_ARG(a0)))
+#define QBDL_PROBE2(name, a0, a1)                                              \
+  __asm__ __volatile__(QBDL_PROBE_ASM(name, "8@%[p0] 8@%[p1]")                 \
+                       :                                                       \
+                       : [p0] "r"(QBDL_PROBE_ARG(a0)),                         \
+                         [p1] "r"(QBDL_PROBE_ARG(a1)))
+#define QBDL_PROBE3(name, a0, a1, a2)                                          \
+  __asm__ __volatile__(QBDL_PROBE_ASM(name, "8@%[p0] 8@%[p1] 8@%[p2]")         \
+                       :                                                       \
+                       : [p0] "r"(QBDL_PROBE_ARG(a0)),                         \
+                         [p1] "r"(QBDL_PROBE_ARG(a1)),                         \
+                         [p2] "r"(QBDL_PROBE_ARG(a2)))
+
+#else
+
+// Arguments are not evaluated
+#define QBDL_PROBE0(name)                                                      \
+  do {                                                                         \
+  } while (0)
+#define QBDL_PROBE1(name, a0) (void)sizeof(a0)
+#define QBDL_PROBE2(name, a0, a1) (void)sizeof(a0), (void)sizeof(a1)
+#define QBDL_PROBE3(name, a0, a1, a2)                                          \
+  (void)sizeof(a0), (void)sizeof(a1), (void)sizeof(a2)
+
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#include "profile.hpp"
+#include "logging.hpp"
+#include <QBDL/profile.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+namespace QBDL {
+
+namespace {
+std::mutex profile_dir_lock_;
+std::string profile_dir_;
+} // namespace
+
+void setBindingProfileDirectory(std::string dir) {
+  std::lock_guard<std::mutex> guard{profile_dir_lock_};
+  profile_dir_ = std::move(dir);
+}
+
+std::string BindingProfile::path(uint64_t binary_hash) {
+  std::lock_guard<std::mutex> guard{profile_dir_lock_};
+  if (profile_dir_.empty()) {
+    return {};
+  }
+  char name[32];
+  snprintf(name, sizeof(name), "/%016" PRIx64 ".qbdlprof", binary_hash);
+  return profile_dir_ + name;
+}
+
+void BindingProfile::load(const std::string &path) {
+  std::ifstream ifs{path};
+  uint64_t count;
+  std::string name;
+  while (ifs >> count >> name) {
+    if (index_.count(name) == 0) {
+      index_.emplace(name, entries_.size());
+      entries_.push_back({std::move(name), count});
+    }
+  }
+  QBDL_DEBUG("Binding profile {}: {} imports", path, entries_.size());
+}
+
+bool BindingProfile::save(const std::string &path) const {
+  std::ofstream ofs{path, std::ios::trunc};
+  if (!ofs) {
+    Logger::err("Unable to write the binding profile {}", path);
+    return false;
+  }
+  for (const Entry &entry : entries_) {
+    ofs << entry.count << ' ' << entry.name << '\n';
+  }
+  return static_cast<bool>(ofs);
+}
+
+bool BindingProfile::contains(std::string_view name) const {
+  return index_.count(std::string{name}) != 0;
+}
+
+void BindingProfile::record(std::vector<std::string_view> const &touched) {
+  for (std::string_view name : touched) {
+    std::string key{name};
+    const auto it = index_.find(key);
+    if (it != std::end(index_)) {
+      ++entries_[it->second].count;
+      continue;
+    }
+    index_.emplace(key, entries_.size());
+    entries_.push_back({std::move(key), 1});
+  }
+}
+
+} // namespace QBDL
@@ -0,0 +1,61 @@
+#ifndef QBDL_BINDING_PROFILE_H_
+#define QBDL_BINDING_PROFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace QBDL {
+
+/** Imports that have been resolved lazily during previous runs of a
+ * binary, used by BIND::PROFILE.
+ *
+ * The on-disk format is a text file with one import per line, in first-touch
+ * order: `<count> <name>`, where count is the number of runs in which the
+ * import has been resolved.
+ */
+class BindingProfile {
+public:
+  /** Computes the path of the profile of a binary, or an empty string if
+   * profiles are disabled.
+   */
+  static std::string path(uint64_t binary_hash);
+
+  /** Loads the profile stored in \p path. A missing file is an empty
+   * profile.
+   */
+  void load(const std::string &path);
+  bool save(const std::string &path) const;
+
+  bool contains(std::string_view name) const;
+
+  /** Merges the imports resolved during a run, given in first-touch order.
+   */
+  void record(std::vector<std::string_view> const &touched);
+
+private:
+  struct Entry {
+    std::string name;
+    uint64_t count;
+  };
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+};
+
+/** 64-bit FNV-1a hash, used to identify binaries.
+ */
+static inline uint64_t fnv1a(const void *data, size_t len,
+                             uint64_t hash = 0xcbf29ce484222325ULL) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,109 @@
+#include "registry.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace QBDL {
+
+namespace {
+// The registry is an immutable snapshot of the images sorted by address,
+// replaced as a whole on each update (read-copy-update).
+//
+// Readers announce themselves in the counter of the current epoch. Writers
+// publish the new snapshot, switch to the next epoch, and wait for the
+// readers of the previous epoch to leave before freeing the old snapshot.
+// Readers never wait, so that they can run in signal handlers, including
+// one that interrupted a writer.
+struct Snapshot {
+  std::vector<LoadedImage> images;
+};
+
+std::atomic<Snapshot *> current{nullptr};
+std::atomic<uint64_t> epoch{0};
+std::atomic<uint64_t> readers[2];
+std::mutex writers;
+
+static_assert(std::atomic<Snapshot *>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "The registry must be lock-free to be async-signal-safe");
+
+// writers must be held
+void publish(Snapshot *snapshot) {
+  Snapshot *old = current.exchange(snapshot);
+  const uint64_t old_epoch = epoch.fetch_add(1);
+  while (readers[old_epoch & 1].load() != 0) {
+    std::this_thread::yield();
+  }
+  delete old;
+}
+} // namespace
+
+void registry_add(LoadedImage const &image) {
+  std::lock_guard<std::mutex> lock(writers);
+  auto *snapshot = new Snapshot{};
+  if (const Snapshot *cur = current.load()) {
+    snapshot->images = cur->images;
+  }
+  std::vector<LoadedImage> &images = snapshot->images;
+  const auto it = std::upper_bound(
+      std::begin(images), std::end(images), image.begin,
+      [](uint64_t addr, const LoadedImage &img) { return addr < img.begin; });
+  images.insert(it, image);
+  publish(snapshot);
+}
+
+void registry_remove(Loader const *loader) {
+  std::lock_guard<std::mutex> lock(writers);
+  const Snapshot *cur = current.load();
+  if (cur == nullptr) {
+    return;
+  }
+  auto *snapshot = new Snapshot{};
+  std::copy_if(
+      std::begin(cur->images), std::end(cur->images),
+      std::back_inserter(snapshot->images),
+      [loader](const LoadedImage &img) { return img.loader != loader; });
+  publish(snapshot);
+}
+
+bool findLoadedImage(uint64_t address, LoadedImage &image) {
+  uint64_t slot;
+  while (true) {
+    const uint64_t cur_epoch = epoch.load();
+    slot = cur_epoch & 1;
+    readers[slot].fetch_add(1);
+    // The writer may have waited for this counter before we incremented it
+    if (epoch.load() == cur_epoch) {
+      break;
+    }
+    readers[slot].fetch_sub(1);
+  }
+
+  bool found = false;
+  if (const Snapshot *snapshot = current.load()) {
+    const std::vector<LoadedImage> &images = snapshot->images;
+    // Last image starting at or before address
+    size_t lo = 0;
+    size_t hi = images.size();
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (images[mid].begin <= address) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo > 0 && address < images[lo - 1].end) {
+      image = images[lo - 1];
+      found = true;
+    }
+  }
+  readers[slot].fetch_sub(1);
+  return found;
+}
+
+} // namespace QBDL
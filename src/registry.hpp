@@ -0,0 +1,13 @@
+#ifndef QBDL_REGISTRY_INTERNAL_H_
+#define QBDL_REGISTRY_INTERNAL_H_
+
+#include <QBDL/registry.hpp>
+
+namespace QBDL {
+
+void registry_add(LoadedImage const &image);
+void registry_remove(Loader const *loader);
+
+} // namespace QBDL
+
+#endif
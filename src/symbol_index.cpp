@@ -0,0 +1,99 @@
+#include "symbol_index.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace QBDL {
+
+void sort_functions(std::vector<FunctionSymbol> &functions,
+                    uint64_t image_end) {
+  // Symbol tables often list the same function several times (e.g. in the
+  // ELF static and dynamic symbol tables)
+  std::sort(std::begin(functions), std::end(functions),
+            [](const FunctionSymbol &lhs, const FunctionSymbol &rhs) {
+              return lhs.address < rhs.address ||
+                     (lhs.address == rhs.address && lhs.name < rhs.name);
+            });
+  functions.erase(std::unique(std::begin(functions), std::end(functions),
+                              [](const FunctionSymbol &lhs,
+                                 const FunctionSymbol &rhs) {
+                                return lhs.address == rhs.address &&
+                                       lhs.name == rhs.name;
+                              }),
+                  std::end(functions));
+
+  // Sizes up to the next distinct address, scanning backwards
+  uint64_t next = image_end;
+  uint64_t last = image_end;
+  for (auto it = functions.rbegin(); it != functions.rend(); ++it) {
+    if (it->address != last) {
+      next = last;
+      last = it->address;
+    }
+    if (it->size == 0 && it->address < next) {
+      it->size = next - it->address;
+    }
+  }
+}
+
+SymbolIndex::SymbolIndex(std::vector<FunctionSymbol> functions,
+                         uint64_t base_address, uint64_t mem_size) {
+  static constexpr uint64_t MAX = std::numeric_limits<uint32_t>::max();
+  sort_functions(functions, base_address + mem_size);
+  entries_.reserve(functions.size());
+  for (const FunctionSymbol &func : functions) {
+    if (func.name.empty() || func.address < base_address) {
+      continue;
+    }
+    const uint64_t rva = func.address - base_address;
+    if (rva > MAX || names_.size() > MAX) {
+      continue;
+    }
+    entries_.push_back({static_cast<uint32_t>(rva),
+                        static_cast<uint32_t>(std::min(func.size, MAX)),
+                        static_cast<uint32_t>(names_.size()), 0});
+    names_.append(func.name);
+    names_.push_back('\0');
+  }
+
+  // The functions that may contain the start of an entry form a stack:
+  // the ones that end before it can't contain anything after it either.
+  std::vector<uint32_t> open;
+  for (size_t idx = 0; idx < entries_.size(); ++idx) {
+    Entry &entry = entries_[idx];
+    while (!open.empty()) {
+      const Entry &top = entries_[open.back() - 1];
+      if (uint64_t{top.rva} + top.size > entry.rva) {
+        break;
+      }
+      open.pop_back();
+    }
+    entry.parent = open.empty() ? 0 : open.back();
+    open.push_back(static_cast<uint32_t>(idx + 1));
+  }
+  entries_.shrink_to_fit();
+  names_.shrink_to_fit();
+}
+
+bool SymbolIndex::lookup(uint64_t rva, std::string_view &name,
+                         uint64_t &func_rva) const {
+  // Last function starting at or before rva
+  auto it = std::upper_bound(
+      std::begin(entries_), std::end(entries_), rva,
+      [](uint64_t value, const Entry &entry) { return value < entry.rva; });
+  if (it == std::begin(entries_)) {
+    return false;
+  }
+  const Entry *entry = &*std::prev(it);
+  while (rva - entry->rva >= entry->size) {
+    if (entry->parent == 0) {
+      return false;
+    }
+    entry = &entries_[entry->parent - 1];
+  }
+  name = std::string_view{names_.c_str() + entry->name};
+  func_rva = entry->rva;
+  return true;
+}
+
+} // namespace QBDL
@@ -0,0 +1,59 @@
+#ifndef QBDL_SYMBOL_INDEX_H_
+#define QBDL_SYMBOL_INDEX_H_
+
+#include <QBDL/Loader.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace QBDL {
+
+/** Sorts \p functions by address, removes duplicates, and gives the
+ * functions without a size the size up to the next function, or up to
+ * \p image_end for the last one.
+ */
+void sort_functions(std::vector<FunctionSymbol> &functions,
+                    uint64_t image_end);
+
+/** Address to function index of a loaded binary.
+ *
+ * Functions are stored as a sorted array of (RVA, size, name offset, parent)
+ * 32-bit integers, the names being copied in a single pool. The parent of a
+ * function is the closest previous one that may still contain its start, so
+ * that addresses past the end of a nested function (or of a shorter alias)
+ * are found in the enclosing one.
+ */
+class SymbolIndex {
+public:
+  SymbolIndex(std::vector<FunctionSymbol> functions, uint64_t base_address,
+              uint64_t mem_size);
+
+  /** Finds the function containing \p rva.
+   *
+   * @param[in] rva Address relative to the base address of the binary
+   * @param[out] name Name of the function
+   * @param[out] func_rva Start of the function
+   * @returns false if no function contains \p rva. If several functions
+   * do, the one starting last is chosen.
+   */
+  bool lookup(uint64_t rva, std::string_view &name, uint64_t &func_rva) const;
+
+  size_t size() const { return entries_.size(); }
+
+private:
+  struct Entry {
+    uint32_t rva;
+    uint32_t size;
+    uint32_t name;
+    uint32_t parent; // Index + 1, 0 if none
+  };
+
+  std::vector<Entry> entries_;
+  std::string names_;
+};
+
+} // namespace QBDL
+
+#endif
@@ -0,0 +1,161 @@
+#include "tracing.hpp"
+#include "logging.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace QBDL::tracing {
+
+std::atomic<bool> enabled_{false};
+
+namespace {
+using trace_clock = std::chrono::steady_clock;
+
+struct Event {
+  const char *name;
+  std::string detail;
+  trace_clock::time_point time;
+  char phase; // 'B' or 'E'
+};
+
+// Events of a thread. Buffers are shared with the recorder so that they
+// outlive their thread until the trace is written.
+struct ThreadBuffer {
+  std::mutex mutex;
+  std::vector<Event> events;
+  uint32_t tid;
+};
+
+class Recorder {
+public:
+  std::shared_ptr<ThreadBuffer> add_thread() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = ++last_tid_;
+    buffers_.push_back(buffer);
+    return buffer;
+  }
+
+  void start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Forget the buffers of the threads that are gone
+    std::vector<std::shared_ptr<ThreadBuffer>> alive;
+    for (std::shared_ptr<ThreadBuffer> &buffer : buffers_) {
+      if (buffer.use_count() > 1) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->events.clear();
+        alive.push_back(std::move(buffer));
+      }
+    }
+    buffers_ = std::move(alive);
+    origin_ = trace_clock::now();
+  }
+
+  bool write(const std::string &path);
+
+private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  uint32_t last_tid_{0};
+  trace_clock::time_point origin_;
+};
+
+Recorder &recorder() {
+  static Recorder instance;
+  return instance;
+}
+
+ThreadBuffer &thread_buffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer = recorder().add_thread();
+  return *buffer;
+}
+
+void record(const char *name, std::string detail, char phase) {
+  ThreadBuffer &buffer = thread_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events.push_back(
+      {name, std::move(detail), trace_clock::now(), phase});
+}
+
+void write_escaped(std::ofstream &ofs, std::string_view str) {
+  static constexpr char HEX[] = "0123456789abcdef";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      ofs << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      ofs << "\\u00" << HEX[(c >> 4) & 0xF] << HEX[c & 0xF];
+    } else {
+      ofs << c;
+    }
+  }
+}
+
+bool Recorder::write(const std::string &path) {
+  std::ofstream ofs{path, std::ios::trunc};
+  if (!ofs) {
+    Logger::err("Unable to write the trace {}", path);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (const std::shared_ptr<ThreadBuffer> &buffer : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    for (const Event &event : buffer->events) {
+      // Timestamps are in microseconds
+      const auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          event.time - origin_);
+      ofs << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+          << "\",\"cat\":\"qbdl\",\"ph\":\"" << event.phase
+          << "\",\"pid\":0,\"tid\":" << buffer->tid
+          << ",\"ts\":" << ts.count() / 1000 << '.'
+          << std::to_string(1000 + ts.count() % 1000).substr(1);
+      if (!event.detail.empty()) {
+        ofs << ",\"args\":{\"detail\":\"";
+        write_escaped(ofs, event.detail);
+        ofs << "\"}";
+      }
+      ofs << '}';
+      first = false;
+    }
+    buffer->events.clear();
+  }
+  ofs << "\n]}\n";
+  return static_cast<bool>(ofs);
+}
+} // namespace
+
+void begin(const char *name, std::string_view detail) {
+  record(name, std::string{detail}, 'B');
+}
+
+void begin(const char *name, uint64_t count) {
+  record(name, std::to_string(count), 'B');
+}
+
+void end(const char *name) {
+  // Drop the end of the scopes that are still open when tracing stops
+  if (enabled()) {
+    record(name, {}, 'E');
+  }
+}
+
+} // namespace QBDL::tracing
+
+namespace QBDL {
+
+void startTracing() {
+  tracing::recorder().start();
+  tracing::enabled_.store(true, std::memory_order_relaxed);
+}
+
+bool stopTracing(const std::string &path) {
+  tracing::enabled_.store(false, std::memory_order_relaxed);
+  return tracing::recorder().write(path);
+}
+
+} // namespace QBDL
@@ -0,0 +1,68 @@
+#ifndef QBDL_TRACING_INTERNAL_H_
+#define QBDL_TRACING_INTERNAL_H_
+
+#include <QBDL/tracing.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+#define QBDL_TRACE_CONCAT_(a, b) a##b
+#define QBDL_TRACE_CONCAT(a, b) QBDL_TRACE_CONCAT_(a, b)
+
+/** Records a begin event now and the matching end event at the end of the
+ * enclosing scope. Takes a static name, optionally followed by a detail (a
+ * string or a count) that is only copied when tracing is enabled.
+ */
+#define QBDL_TRACE_SCOPE(...)                                                  \
+  ::QBDL::tracing::Scope QBDL_TRACE_CONCAT(qbdl_trace_scope_,                  \
+                                           __LINE__)(__VA_ARGS__)
+
+namespace QBDL::tracing {
+
+extern std::atomic<bool> enabled_;
+
+inline bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+void begin(const char *name, std::string_view detail);
+void begin(const char *name, uint64_t count);
+void end(const char *name);
+
+class Scope {
+public:
+  explicit Scope(const char *name) : name_(enabled() ? name : nullptr) {
+    if (name_ != nullptr) {
+      begin(name_, std::string_view{});
+    }
+  }
+
+  Scope(const char *name, std::string_view detail)
+      : name_(enabled() ? name : nullptr) {
+    if (name_ != nullptr) {
+      begin(name_, detail);
+    }
+  }
+
+  Scope(const char *name, uint64_t count) : name_(enabled() ? name : nullptr) {
+    if (name_ != nullptr) {
+      begin(name_, count);
+    }
+  }
+
+  ~Scope() {
+    if (name_ != nullptr) {
+      end(name_);
+    }
+  }
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+
+private:
+  // nullptr if tracing was disabled when the scope was entered
+  const char *name_;
+};
+
+} // namespace QBDL::tracing
+
+#endif
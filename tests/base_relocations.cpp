@@ -0,0 +1,77 @@
+#include "base_relocations.hpp"
+#include "check.hpp"
+#include "fixups.hpp"
+#include "intmem.hpp"
+#include "memory.hpp"
+
+using namespace QBDL;
+
+namespace {
+constexpr uint8_t IMAGE_REL_BASED_ABSOLUTE = 0;
+constexpr uint8_t IMAGE_REL_BASED_HIGH = 1;
+constexpr uint8_t IMAGE_REL_BASED_HIGHLOW = 3;
+constexpr uint8_t IMAGE_REL_BASED_DIR64 = 10;
+
+constexpr uint64_t BASE = 0x7ff000000000;
+const Arch X86_64{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, true};
+const Arch X86{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, false};
+
+void test_dir64() {
+  // Image linked at 0x140000000, loaded at BASE
+  constexpr uint64_t IMAGEBASE = 0x140000000;
+  constexpr uint64_t DELTA = BASE - IMAGEBASE;
+  BufferMemory mem{BASE, 0x2000};
+  intmem::storeu_le<uint64_t>(mem.at(BASE + 0x1008), IMAGEBASE + 0x1500);
+  intmem::storeu_le<uint64_t>(mem.at(BASE + 0x1ff8), IMAGEBASE);
+
+  FixupBatch batch{mem, X86_64};
+  CHECK(push_base_relocation(batch, IMAGE_REL_BASED_DIR64, BASE + 0x1008,
+                             DELTA));
+  CHECK(push_base_relocation(batch, IMAGE_REL_BASED_DIR64, BASE + 0x1ff8,
+                             DELTA));
+  // Padding entry at the end of the block
+  CHECK(push_base_relocation(batch, IMAGE_REL_BASED_ABSOLUTE, BASE + 0x1000,
+                             DELTA));
+  CHECK(batch.size() == 2);
+  batch.flush();
+
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x1008)) == BASE + 0x1500);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x1ff8)) == BASE);
+  // Untouched by the padding
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x1000)) == 0);
+  // One block, one page
+  CHECK(mem.reads == 1);
+  CHECK(mem.writes == 1);
+}
+
+void test_highlow() {
+  // 32-bit image loaded below its preferred base: the delta wraps around
+  constexpr uint64_t IMAGEBASE = 0x400000;
+  constexpr uint64_t LOADED = 0x10000;
+  const uint64_t delta = LOADED - IMAGEBASE;
+  BufferMemory mem{LOADED, 0x1000};
+  intmem::storeu_le<uint32_t>(mem.at(LOADED + 0x10), IMAGEBASE + 0x234);
+  intmem::storeu_le<uint32_t>(mem.at(LOADED + 0x14), 0xdeadbeef);
+
+  FixupBatch batch{mem, X86};
+  CHECK(push_base_relocation(batch, IMAGE_REL_BASED_HIGHLOW, LOADED + 0x10,
+                             delta));
+  batch.flush();
+  CHECK(intmem::loadu_le<uint32_t>(mem.at(LOADED + 0x10)) == LOADED + 0x234);
+  CHECK(intmem::loadu_le<uint32_t>(mem.at(LOADED + 0x14)) == 0xdeadbeef);
+}
+
+void test_unsupported() {
+  BufferMemory mem{BASE, 0x1000};
+  FixupBatch batch{mem, X86_64};
+  CHECK(!push_base_relocation(batch, IMAGE_REL_BASED_HIGH, BASE, 1));
+  CHECK(batch.size() == 0);
+}
+} // namespace
+
+int main() {
+  test_dir64();
+  test_highlow();
+  test_unsupported();
+  return 0;
+}
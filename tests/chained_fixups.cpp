@@ -0,0 +1,195 @@
+#include "chained_fixups.hpp"
+#include "check.hpp"
+#include "intmem.hpp"
+
+#include <cstring>
+#include <string>
+
+using namespace QBDL;
+
+namespace {
+constexpr uint16_t DYLD_CHAINED_PTR_ARM64E_USERLAND = 9;
+constexpr uint16_t DYLD_CHAINED_PTR_64 = 2;
+constexpr uint16_t DYLD_CHAINED_PTR_64_OFFSET = 6;
+constexpr uint16_t PAGE_SIZE = 0x100;
+
+// LC_DYLD_CHAINED_FIXUPS payload with two segments: the first one has no
+// fixups, the second one has two pages and a chain in the first one. The
+// imports are _printf (library 1) and _malloc (flat lookup, weak).
+std::vector<uint8_t> make_payload(uint16_t pointer_format,
+                                  uint32_t version = 0) {
+  std::vector<uint8_t> data(96, 0);
+  auto u16 = [&](size_t off, uint16_t v) {
+    intmem::storeu_le<uint16_t>(&data[off], v);
+  };
+  auto u32 = [&](size_t off, uint32_t v) {
+    intmem::storeu_le<uint32_t>(&data[off], v);
+  };
+  // dyld_chained_fixups_header
+  u32(0, version);
+  u32(4, 32); // starts_offset
+  u32(8, 72); // imports_offset
+  u32(12, 80); // symbols_offset
+  u32(16, 2); // imports_count
+  u32(20, 1); // DYLD_CHAINED_IMPORT
+  u32(24, 0); // uncompressed symbols
+  // dyld_chained_starts_in_image
+  u32(32, 2);
+  u32(36, 0);
+  u32(40, 12);
+  // dyld_chained_starts_in_segment
+  u32(44, 26);
+  u16(48, PAGE_SIZE);
+  u16(50, pointer_format);
+  intmem::storeu_le<uint64_t>(&data[52], 0x4000); // segment_offset
+  u32(60, 0);
+  u16(64, 2);      // page_count
+  u16(66, 0x10);   // page_start[0]
+  u16(68, 0xFFFF); // page_start[1]: no fixups
+  // dyld_chained_import: lib_ordinal:8, weak_import:1, name_offset:23
+  u32(72, 1);
+  u32(76, 0xFE | (1 << 8) | (8 << 9));
+  std::memcpy(&data[80], "_printf\0_malloc", 16);
+  return data;
+}
+
+void test_parse() {
+  auto fixups = ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64_OFFSET),
+                                     {0x4000, 0x180});
+  CHECK(fixups != nullptr);
+
+  const auto &pages = fixups->pages();
+  CHECK(pages.size() == 1);
+  CHECK(pages[0].rva == 0x4000);
+  CHECK(pages[0].size == PAGE_SIZE);
+  CHECK(pages[0].start == 0x10);
+  CHECK(pages[0].pointer_format == DYLD_CHAINED_PTR_64_OFFSET);
+
+  const auto &imports = fixups->imports();
+  CHECK(imports.size() == 2);
+  CHECK(imports[0].name == "_printf");
+  CHECK(imports[0].library_ordinal == 1);
+  CHECK(!imports[0].weak);
+  CHECK(imports[1].name == "_malloc");
+  CHECK(imports[1].library_ordinal == -2); // BIND_SPECIAL_DYLIB_FLAT_LOOKUP
+  CHECK(imports[1].weak);
+}
+
+void test_last_page_size() {
+  // The segment ends in the middle of its first page
+  auto fixups = ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64_OFFSET),
+                                     {0x4000, 0x80});
+  CHECK(fixups != nullptr);
+  CHECK(fixups->pages().size() == 1);
+  CHECK(fixups->pages()[0].size == 0x80);
+}
+
+void test_malformed() {
+  CHECK(ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64, 1), {}) ==
+        nullptr);
+  // 32-bit pointer format
+  CHECK(ChainedFixups::parse(make_payload(3), {}) == nullptr);
+
+  std::vector<uint8_t> truncated = make_payload(DYLD_CHAINED_PTR_64);
+  truncated.resize(60);
+  CHECK(ChainedFixups::parse(truncated, {}) == nullptr);
+
+  // Import count past the end of the payload
+  std::vector<uint8_t> imports = make_payload(DYLD_CHAINED_PTR_64);
+  intmem::storeu_le<uint32_t>(&imports[16], 100);
+  CHECK(ChainedFixups::parse(imports, {}) == nullptr);
+}
+
+void test_apply_ptr64() {
+  auto fixups =
+      ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64), {0x4000, 0x180});
+  CHECK(fixups != nullptr);
+  const ChainedFixups::Page &page = fixups->pages()[0];
+
+  constexpr uint64_t IMAGEBASE = 0x100000000;
+  constexpr uint64_t BASE = 0x7f0000000000;
+  std::vector<uint8_t> content(page.size, 0);
+  // Rebase to a preferred address, with high8, next = 2 (4-byte stride)
+  intmem::storeu_le<uint64_t>(&content[0x10], (IMAGEBASE + 0x1234) |
+                                                  (0x12ULL << 36) |
+                                                  (2ULL << 51));
+  // Bind to _malloc + 5, end of the chain
+  intmem::storeu_le<uint64_t>(&content[0x18], (1ULL << 63) | 1 | (5 << 24));
+
+  std::vector<ChainedFixups::Bind> binds;
+  CHECK(fixups->apply_page(page, content.data(), IMAGEBASE, BASE, binds));
+  CHECK(intmem::loadu_le<uint64_t>(&content[0x10]) ==
+        ((BASE + 0x1234) | (0x12ULL << 56)));
+  CHECK(intmem::loadu_le<uint64_t>(&content[0x18]) == 0);
+  CHECK(binds.size() == 1);
+  CHECK(binds[0].rva == 0x4018);
+  CHECK(binds[0].import == 1);
+  CHECK(binds[0].addend == 5);
+}
+
+void test_apply_ptr64_offset() {
+  auto fixups = ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64_OFFSET),
+                                     {0x4000, 0x180});
+  CHECK(fixups != nullptr);
+  const ChainedFixups::Page &page = fixups->pages()[0];
+
+  std::vector<uint8_t> content(page.size, 0);
+  intmem::storeu_le<uint64_t>(&content[0x10], 0x1234);
+  std::vector<ChainedFixups::Bind> binds;
+  CHECK(fixups->apply_page(page, content.data(), 0x100000000, 0x10000, binds));
+  CHECK(intmem::loadu_le<uint64_t>(&content[0x10]) == 0x11234);
+  CHECK(binds.empty());
+}
+
+void test_apply_arm64e() {
+  auto fixups = ChainedFixups::parse(
+      make_payload(DYLD_CHAINED_PTR_ARM64E_USERLAND), {0x4000, 0x180});
+  CHECK(fixups != nullptr);
+  const ChainedFixups::Page &page = fixups->pages()[0];
+
+  std::vector<uint8_t> content(page.size, 0);
+  // Authenticated rebase, next = 1 (8-byte stride)
+  intmem::storeu_le<uint64_t>(&content[0x10],
+                              (1ULL << 63) | (1ULL << 51) | 0x2000);
+  // Bind to _printf - 8 (19-bit signed addend)
+  intmem::storeu_le<uint64_t>(&content[0x18],
+                              (1ULL << 62) | (0x7FFF8ULL << 32) | 0);
+
+  std::vector<ChainedFixups::Bind> binds;
+  CHECK(fixups->apply_page(page, content.data(), 0, 0x10000, binds));
+  CHECK(intmem::loadu_le<uint64_t>(&content[0x10]) == 0x12000);
+  CHECK(binds.size() == 1);
+  CHECK(binds[0].rva == 0x4018);
+  CHECK(binds[0].import == 0);
+  CHECK(binds[0].addend == -8);
+}
+
+void test_apply_malformed() {
+  auto fixups =
+      ChainedFixups::parse(make_payload(DYLD_CHAINED_PTR_64), {0x4000, 0x180});
+  CHECK(fixups != nullptr);
+  const ChainedFixups::Page &page = fixups->pages()[0];
+  std::vector<ChainedFixups::Bind> binds;
+
+  // The chain leaves the page
+  std::vector<uint8_t> content(page.size, 0);
+  intmem::storeu_le<uint64_t>(&content[0x10], 0xFFFULL << 51);
+  CHECK(!fixups->apply_page(page, content.data(), 0, 0, binds));
+
+  // Unknown import
+  content.assign(page.size, 0);
+  intmem::storeu_le<uint64_t>(&content[0x10], (1ULL << 63) | 2);
+  CHECK(!fixups->apply_page(page, content.data(), 0, 0, binds));
+}
+} // namespace
+
+int main() {
+  test_parse();
+  test_last_page_size();
+  test_malformed();
+  test_apply_ptr64();
+  test_apply_ptr64_offset();
+  test_apply_arm64e();
+  test_apply_malformed();
+  return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef QBDL_TESTS_CHECK_H_
+#define QBDL_TESTS_CHECK_H_
+
+#include <cstdio>
+#include <cstdlib>
+
+// Like assert(), but also checked in release builds
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      std::exit(1);                                                            \
+    }                                                                          \
+  } while (0)
+
+#endif
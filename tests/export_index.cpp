@@ -0,0 +1,84 @@
+#include "check.hpp"
+#include "export_index.hpp"
+
+#include <string>
+
+using namespace QBDL;
+
+namespace {
+using KIND = ExportedSymbol::KIND;
+
+void test_empty() {
+  ExportIndex index{{}};
+  CHECK(index.exports().empty());
+  CHECK(index.find("") == nullptr);
+  CHECK(index.find("printf") == nullptr);
+}
+
+void test_find() {
+  ExportIndex index{{{"printf", 0x1000, KIND::FUNCTION},
+                     {"environ", 0x2000, KIND::DATA},
+                     {"puts", 0x3000, KIND::UNKNOWN}}};
+  CHECK(index.exports().size() == 3);
+  const ExportedSymbol *sym = index.find("environ");
+  CHECK(sym != nullptr);
+  CHECK(sym == &index.exports()[1]);
+  CHECK(sym->address == 0x2000 && sym->kind == KIND::DATA);
+  sym = index.find("puts", gnu_hash("puts"));
+  CHECK(sym != nullptr && sym->address == 0x3000);
+  CHECK(index.find("put") == nullptr);
+  CHECK(index.find("printf_") == nullptr);
+  // A lookup with the wrong hash misses
+  CHECK(index.find("printf", gnu_hash("puts")) == nullptr);
+}
+
+void test_duplicates() {
+  // The first definition wins, as with the per-format lookups
+  ExportIndex index{{{"malloc", 0x1000, KIND::FUNCTION},
+                     {"free", 0x2000, KIND::FUNCTION},
+                     {"malloc", 0x3000, KIND::FUNCTION}}};
+  CHECK(index.exports().size() == 3);
+  const ExportedSymbol *sym = index.find("malloc");
+  CHECK(sym != nullptr && sym->address == 0x1000);
+}
+
+void test_collisions() {
+  // "aB" and "b!" have the same GNU hash: 97 * 33 + 66 == 98 * 33 + 33
+  static_assert(gnu_hash("aB") == gnu_hash("b!"));
+  ExportIndex index{{{"aB", 0x1000, KIND::FUNCTION},
+                     {"b!", 0x2000, KIND::FUNCTION}}};
+  const ExportedSymbol *sym = index.find("aB");
+  CHECK(sym != nullptr && sym->address == 0x1000);
+  sym = index.find("b!");
+  CHECK(sym != nullptr && sym->address == 0x2000);
+  CHECK(index.find("aC", gnu_hash("aB")) == nullptr);
+}
+
+void test_many() {
+  // Enough entries to grow the table and wrap probe sequences around
+  std::vector<std::string> names;
+  for (size_t idx = 0; idx < 1000; ++idx) {
+    names.push_back("sym" + std::to_string(idx));
+  }
+  std::vector<ExportedSymbol> exports;
+  for (size_t idx = 0; idx < names.size(); ++idx) {
+    exports.push_back({names[idx], 0x1000 + idx * 0x10, KIND::FUNCTION});
+  }
+  ExportIndex index{std::move(exports)};
+  for (size_t idx = 0; idx < names.size(); ++idx) {
+    const ExportedSymbol *sym = index.find(names[idx]);
+    CHECK(sym != nullptr && sym->address == 0x1000 + idx * 0x10);
+  }
+  CHECK(index.find("sym1000") == nullptr);
+  CHECK(index.find("sym") == nullptr);
+}
+} // namespace
+
+int main() {
+  test_empty();
+  test_find();
+  test_duplicates();
+  test_collisions();
+  test_many();
+  return 0;
+}
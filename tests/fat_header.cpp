@@ -0,0 +1,86 @@
+#include "check.hpp"
+#include "fat_header.hpp"
+#include "intmem.hpp"
+
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+constexpr uint32_t CPU_TYPE_X86_64 = 0x01000007;
+constexpr uint32_t CPU_TYPE_ARM64 = 0x0100000c;
+constexpr uint32_t CPU_TYPE_MC680X0 = 6;
+
+std::vector<uint8_t> make_header(uint32_t magic, uint32_t nfat_arch) {
+  std::vector<uint8_t> header(8);
+  intmem::storeu_be<uint32_t>(&header[0], magic);
+  intmem::storeu_be<uint32_t>(&header[4], nfat_arch);
+  return header;
+}
+
+void test_header_size() {
+  CHECK(fat_header_size(make_header(0xcafebabe, 2).data()) == 8 + 2 * 20);
+  CHECK(fat_header_size(make_header(0xcafebabf, 3).data()) == 8 + 3 * 32);
+  CHECK(fat_header_size(make_header(0xcafebabe, 0).data()) == 8);
+  // Thin Mach-O (MH_MAGIC_64, little endian)
+  CHECK(fat_header_size(make_header(0xcffaedfe, 2).data()) == 0);
+  // Java class file, version 52
+  CHECK(fat_header_size(make_header(0xcafebabe, 52 << 16).data()) == 0);
+}
+
+void test_slices_32() {
+  std::vector<uint8_t> header = make_header(0xcafebabe, 2);
+  header.resize(fat_header_size(header.data()));
+  uint8_t *entry = &header[8];
+  intmem::storeu_be<uint32_t>(entry, CPU_TYPE_X86_64);
+  intmem::storeu_be<uint32_t>(entry + 8, 0x4000);
+  intmem::storeu_be<uint32_t>(entry + 12, 0x1234);
+  entry += 20;
+  intmem::storeu_be<uint32_t>(entry, CPU_TYPE_ARM64);
+  intmem::storeu_be<uint32_t>(entry + 8, 0x8000);
+  intmem::storeu_be<uint32_t>(entry + 12, 0x5678);
+
+  const std::vector<FatSlice> slices = fat_slices(header.data());
+  CHECK(slices.size() == 2);
+  CHECK(slices[0].cputype == CPU_TYPE_X86_64);
+  CHECK(slices[0].offset == 0x4000);
+  CHECK(slices[0].size == 0x1234);
+  CHECK(slices[1].cputype == CPU_TYPE_ARM64);
+  CHECK(slices[1].offset == 0x8000);
+  CHECK(slices[1].size == 0x5678);
+}
+
+void test_slices_64() {
+  std::vector<uint8_t> header = make_header(0xcafebabf, 1);
+  header.resize(fat_header_size(header.data()));
+  uint8_t *entry = &header[8];
+  intmem::storeu_be<uint32_t>(entry, CPU_TYPE_ARM64);
+  intmem::storeu_be<uint64_t>(entry + 8, 0x100000000);
+  intmem::storeu_be<uint64_t>(entry + 16, 0x200000000);
+
+  const std::vector<FatSlice> slices = fat_slices(header.data());
+  CHECK(slices.size() == 1);
+  CHECK(slices[0].cputype == CPU_TYPE_ARM64);
+  CHECK(slices[0].offset == 0x100000000);
+  CHECK(slices[0].size == 0x200000000);
+}
+
+void test_arch() {
+  CHECK((fat_arch(CPU_TYPE_X86_64) ==
+         Arch{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, true}));
+  CHECK((fat_arch(7) == Arch{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, false}));
+  CHECK((fat_arch(CPU_TYPE_ARM64) ==
+         Arch{LIEF::ARCH_ARM64, LIEF::ENDIAN_LITTLE, true}));
+  CHECK((fat_arch(12) == Arch{LIEF::ARCH_ARM, LIEF::ENDIAN_LITTLE, false}));
+  CHECK((fat_arch(18) == Arch{LIEF::ARCH_PPC, LIEF::ENDIAN_BIG, false}));
+  CHECK(!fat_arch(CPU_TYPE_MC680X0));
+}
+} // namespace
+
+int main() {
+  test_header_size();
+  test_slices_32();
+  test_slices_64();
+  test_arch();
+  return 0;
+}
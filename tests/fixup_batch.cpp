@@ -0,0 +1,98 @@
+#include "check.hpp"
+#include "fixups.hpp"
+#include "intmem.hpp"
+#include "memory.hpp"
+
+using namespace QBDL;
+
+namespace {
+constexpr uint64_t BASE = 0x10000;
+const Arch X86_64{LIEF::ARCH_X86, LIEF::ENDIAN_LITTLE, true};
+const Arch PPC{LIEF::ARCH_PPC, LIEF::ENDIAN_BIG, false};
+
+void test_kinds() {
+  BufferMemory mem{BASE, 0x1000};
+  intmem::storeu_le<uint64_t>(mem.at(BASE + 0x10), 0x1000);
+  intmem::storeu_le<uint32_t>(mem.at(BASE + 0x20), 0xFFFFFFF0);
+
+  FixupBatch batch{mem, X86_64};
+  batch.set_ptr(BASE + 0x8, 0x1122334455667788);
+  batch.push(BASE + 0x10, 0x234, 8, FixupBatch::KIND::ADD);
+  // 32-bit additions wrap around without touching the next bytes
+  batch.push(BASE + 0x20, 0x20, 4, FixupBatch::KIND::ADD);
+  CHECK(batch.size() == 3);
+  batch.flush();
+  CHECK(batch.size() == 0);
+
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x8)) == 0x1122334455667788);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x10)) == 0x1234);
+  CHECK(intmem::loadu_le<uint32_t>(mem.at(BASE + 0x20)) == 0x10);
+  CHECK(intmem::loadu_le<uint32_t>(mem.at(BASE + 0x24)) == 0);
+}
+
+void test_order() {
+  // Fixups of the same address are applied in the order they were queued
+  BufferMemory mem{BASE, 0x1000};
+  FixupBatch batch{mem, X86_64};
+  batch.push(BASE + 0x100, 5, 8, FixupBatch::KIND::ADD);
+  batch.push(BASE, 1, 8, FixupBatch::KIND::SET);
+  batch.push(BASE + 0x100, 0x40, 8, FixupBatch::KIND::SET);
+  batch.push(BASE + 0x100, 2, 8, FixupBatch::KIND::ADD);
+  batch.flush();
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x100)) == 0x42);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE)) == 1);
+}
+
+void test_big_endian() {
+  BufferMemory mem{BASE, 0x1000};
+  intmem::storeu_be<uint32_t>(mem.at(BASE + 4), 0x100);
+  FixupBatch batch{mem, PPC};
+  batch.set_ptr(BASE, 0x11223344);
+  batch.push(BASE + 4, 0x23, 4, FixupBatch::KIND::ADD);
+  batch.flush();
+  CHECK(mem.at(BASE)[0] == 0x11 && mem.at(BASE)[3] == 0x44);
+  CHECK(intmem::loadu_be<uint32_t>(mem.at(BASE + 4)) == 0x123);
+}
+
+void test_pages() {
+  // One read and one write per page, whatever the order of the fixups
+  BufferMemory mem{BASE, 0x3000};
+  FixupBatch batch{mem, X86_64};
+  batch.set_ptr(BASE + 0x2008, 3);
+  batch.set_ptr(BASE + 0x10, 1);
+  batch.set_ptr(BASE + 0x2ff8, 4);
+  batch.set_ptr(BASE + 0x800, 2);
+  batch.flush();
+  CHECK(mem.reads == 2);
+  CHECK(mem.writes == 2);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x10)) == 1);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x800)) == 2);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x2008)) == 3);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x2ff8)) == 4);
+
+  // Nothing queued: no access
+  batch.flush();
+  CHECK(mem.reads == 2);
+  CHECK(mem.writes == 2);
+}
+
+void test_page_crossing() {
+  // A fixup that starts at the end of a page extends its span
+  BufferMemory mem{BASE, 0x2000};
+  FixupBatch batch{mem, X86_64};
+  batch.set_ptr(BASE + 0xffc, 0x1122334455667788);
+  batch.set_ptr(BASE + 0x1004, 1);
+  batch.flush();
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0xffc)) == 0x1122334455667788);
+  CHECK(intmem::loadu_le<uint64_t>(mem.at(BASE + 0x1004)) == 1);
+}
+} // namespace
+
+int main() {
+  test_kinds();
+  test_order();
+  test_big_endian();
+  test_pages();
+  test_page_crossing();
+  return 0;
+}
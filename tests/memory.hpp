@@ -0,0 +1,41 @@
+#ifndef QBDL_TESTS_MEMORY_H_
+#define QBDL_TESTS_MEMORY_H_
+
+#include "check.hpp"
+#include <QBDL/Engine.hpp>
+
+#include <cstring>
+#include <vector>
+
+// Target memory backed by a buffer mapped at a fixed address, that counts
+// the accesses made to it
+class BufferMemory : public QBDL::TargetMemory {
+public:
+  BufferMemory(uint64_t base, size_t size) : base_(base), data_(size, 0) {}
+
+  uint64_t mmap(uint64_t, size_t) override { return 0; }
+  bool mprotect(uint64_t, size_t, int) override { return true; }
+
+  void write(uint64_t addr, const void *buf, size_t len) override {
+    CHECK(addr >= base_ && addr - base_ + len <= data_.size());
+    std::memcpy(&data_[addr - base_], buf, len);
+    ++writes;
+  }
+
+  void read(void *dst, uint64_t addr, size_t len) override {
+    CHECK(addr >= base_ && addr - base_ + len <= data_.size());
+    std::memcpy(dst, &data_[addr - base_], len);
+    ++reads;
+  }
+
+  uint8_t *at(uint64_t addr) { return &data_[addr - base_]; }
+
+  size_t reads = 0;
+  size_t writes = 0;
+
+private:
+  uint64_t base_;
+  std::vector<uint8_t> data_;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "check.hpp"
+#include "engines/NativeTLS.hpp"
+
+#include <cstring>
+#include <thread>
+
+using namespace QBDL;
+
+namespace {
+// Initialization image of the test modules (.tdata)
+const uint8_t IMAGE[16] = {1, 2,  3,  4,  5,  6,  7,  8,
+                           9, 10, 11, 12, 13, 14, 15, 16};
+
+uint64_t add_module(TargetTLS &tls, uint64_t mem_size, uint64_t align = 16) {
+  return tls.add_module(reinterpret_cast<uintptr_t>(IMAGE), sizeof(IMAGE),
+                        mem_size, align);
+}
+
+uintptr_t thread_pointer() {
+  uintptr_t tp;
+#if defined(__x86_64__)
+  asm("movq %%fs:0, %0" : "=r"(tp));
+#else
+  asm("mrs %0, tpidr_el0" : "=r"(tp));
+#endif
+  return tp;
+}
+
+// Calls the resolver of the TLS descriptor \p desc as compiled code does,
+// and checks that it only changes the result register
+uint8_t *call_tlsdesc(const uint64_t *desc) {
+#if defined(__x86_64__)
+  uint64_t result = reinterpret_cast<uintptr_t>(desc);
+  uint64_t rdi = 1, rsi = 2, rcx = 3, rdx = 4;
+  register uint64_t r8 asm("r8") = 5;
+  register uint64_t r11 asm("r11") = 6;
+  register double xmm0 asm("xmm0") = 7.5;
+  register double xmm15 asm("xmm15") = 8.5;
+  asm volatile("call *(%%rax)"
+               : "+a"(result), "+D"(rdi), "+S"(rsi), "+c"(rcx), "+d"(rdx),
+                 "+r"(r8), "+r"(r11), "+x"(xmm0), "+x"(xmm15)
+               :
+               : "memory", "cc");
+  CHECK(rdi == 1 && rsi == 2 && rcx == 3 && rdx == 4);
+  CHECK(r8 == 5 && r11 == 6);
+  CHECK(xmm0 == 7.5 && xmm15 == 8.5);
+#else
+  register uint64_t result asm("x0") = reinterpret_cast<uintptr_t>(desc);
+  register uint64_t x2 asm("x2") = 2;
+  register uint64_t x17 asm("x17") = 17;
+  register double d0 asm("d0") = 7.5;
+  register double d31 asm("d31") = 8.5;
+  asm volatile("ldr x1, [x0]\n"
+               "blr x1"
+               : "+r"(result), "+r"(x2), "+r"(x17), "+w"(d0), "+w"(d31)
+               :
+               : "x1", "x30", "memory", "cc");
+  CHECK(x2 == 2 && x17 == 17);
+  CHECK(d0 == 7.5 && d31 == 8.5);
+#endif
+  return reinterpret_cast<uint8_t *>(thread_pointer() + result);
+}
+
+void test_tlsdesc_dynamic(TargetTLS &tls) {
+  // Larger than the whole static area
+  const uint64_t module = add_module(tls, 4096);
+  CHECK(module != 0);
+  tls.activate_module(module);
+  const uint64_t desc[2] = {tls.tlsdesc_dynamic_function(),
+                            tls.tlsdesc_argument(module, 4)};
+  CHECK(desc[0] != 0 && desc[1] != 0);
+
+  uint8_t *var = call_tlsdesc(desc);
+  CHECK(var[0] == 5 && var[11] == 16 && var[12] == 0);
+  var[0] = 42;
+  CHECK(call_tlsdesc(desc) == var);
+
+  // Threads get their own initialized block on first access, without
+  // init_thread_tls()
+  std::thread{[&] {
+    uint8_t *other = call_tlsdesc(desc);
+    CHECK(other != var);
+    CHECK(other[0] == 5 && other[11] == 16 && other[4092] == 0);
+    CHECK(call_tlsdesc(desc) == other);
+  }}.join();
+  CHECK(var[0] == 42);
+  tls.remove_module(module);
+}
+
+void test_static_reuse(TargetTLS &tls) {
+  // Loading and unloading the same binary never exhausts the static area
+  int64_t first = 0;
+  for (int idx = 0; idx < 100; ++idx) {
+    const uint64_t module = add_module(tls, 256);
+    CHECK(module != 0);
+    int64_t offset = 0;
+    CHECK(tls.static_offset(module, offset));
+    if (idx == 0) {
+      first = offset;
+    }
+    CHECK(offset == first);
+    tls.activate_module(module);
+    tls.remove_module(module);
+  }
+}
+
+void test_static_holes(TargetTLS &tls) {
+  const uint64_t a = add_module(tls, 128);
+  const uint64_t b = add_module(tls, 128);
+  const uint64_t c = add_module(tls, 128);
+  int64_t off_a = 0;
+  int64_t off_b = 0;
+  int64_t off_c = 0;
+  CHECK(tls.static_offset(a, off_a));
+  CHECK(tls.static_offset(b, off_b));
+  CHECK(tls.static_offset(c, off_c));
+  // The area is full
+  const uint64_t big = add_module(tls, 256);
+  int64_t offset = 0;
+  CHECK(!tls.static_offset(big, offset));
+
+  // Freeing two neighbors makes room for a larger block
+  tls.remove_module(a);
+  tls.remove_module(b);
+  CHECK(tls.static_offset(big, offset));
+  CHECK(offset == off_a);
+
+  // A smaller one fits in the hole left by another one
+  tls.remove_module(c);
+  const uint64_t small = add_module(tls, 64);
+  CHECK(tls.static_offset(small, offset));
+  CHECK(offset == off_c);
+  tls.remove_module(small);
+  tls.remove_module(big);
+}
+} // namespace
+
+int main() {
+  TargetTLS *tls = Engines::Native::tls_handler();
+  if (tls == nullptr) {
+    // No native TLS support on this host
+    return 0;
+  }
+  test_static_reuse(*tls);
+  test_static_holes(*tls);
+  test_tlsdesc_dynamic(*tls);
+  return 0;
+}
@@ -0,0 +1,96 @@
+#include "check.hpp"
+#include "registry.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+// The registry never dereferences the loaders
+Loader *fake_loader(uintptr_t id) { return reinterpret_cast<Loader *>(id); }
+
+void test_empty() {
+  LoadedImage image{};
+  CHECK(!findLoadedImage(0, image));
+  CHECK(!findLoadedImage(0x1000, image));
+  // Removing an unknown loader is harmless
+  registry_remove(fake_loader(0x10));
+  CHECK(!findLoadedImage(0x1000, image));
+}
+
+void test_lookup() {
+  // Registered out of order
+  registry_add({fake_loader(0x20), 0x20000, 0x30000});
+  registry_add({fake_loader(0x10), 0x10000, 0x18000});
+  registry_add({fake_loader(0x30), 0x30000, 0x31000});
+
+  LoadedImage image{};
+  CHECK(findLoadedImage(0x10000, image));
+  CHECK(image.loader == fake_loader(0x10));
+  CHECK(image.begin == 0x10000 && image.end == 0x18000);
+  CHECK(findLoadedImage(0x17fff, image));
+  CHECK(image.loader == fake_loader(0x10));
+  // Between two images, before the first one, and after the last one
+  CHECK(!findLoadedImage(0x18000, image));
+  CHECK(!findLoadedImage(0xffff, image));
+  CHECK(!findLoadedImage(0x31000, image));
+  // Adjacent images: the end is exclusive
+  CHECK(findLoadedImage(0x2ffff, image));
+  CHECK(image.loader == fake_loader(0x20));
+  CHECK(findLoadedImage(0x30000, image));
+  CHECK(image.loader == fake_loader(0x30));
+
+  registry_remove(fake_loader(0x20));
+  CHECK(!findLoadedImage(0x20000, image));
+  CHECK(findLoadedImage(0x30000, image));
+  CHECK(image.loader == fake_loader(0x30));
+
+  registry_remove(fake_loader(0x10));
+  registry_remove(fake_loader(0x30));
+  CHECK(!findLoadedImage(0x10000, image));
+  CHECK(!findLoadedImage(0x30000, image));
+}
+
+void test_concurrent() {
+  // Readers always see the permanent image, and a consistent view of the
+  // one that comes and goes
+  registry_add({fake_loader(0x100), 0x100000, 0x200000});
+  std::atomic<bool> stop{false};
+  std::atomic<bool> failed{false};
+  std::vector<std::thread> readers;
+  for (int idx = 0; idx < 4; ++idx) {
+    readers.emplace_back([&] {
+      LoadedImage image{};
+      while (!stop.load()) {
+        if (!findLoadedImage(0x150000, image) ||
+            image.loader != fake_loader(0x100)) {
+          failed = true;
+        }
+        if (findLoadedImage(0x300000, image) &&
+            (image.loader != fake_loader(0x200) || image.begin != 0x300000)) {
+          failed = true;
+        }
+      }
+    });
+  }
+  for (int idx = 0; idx < 1000; ++idx) {
+    registry_add({fake_loader(0x200), 0x300000, 0x400000});
+    registry_remove(fake_loader(0x200));
+  }
+  stop = true;
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+  CHECK(!failed);
+  registry_remove(fake_loader(0x100));
+}
+} // namespace
+
+int main() {
+  test_empty();
+  test_lookup();
+  test_concurrent();
+  return 0;
+}
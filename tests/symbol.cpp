@@ -0,0 +1,37 @@
+#include "check.hpp"
+
+#include <QBDL/symbol.hpp>
+
+#include <string>
+
+using namespace QBDL;
+using namespace QBDL::literals;
+
+namespace {
+// Values from the DT_GNU_HASH tables of glibc and libstdc++
+static_assert(gnu_hash("") == 5381);
+static_assert(gnu_hash("printf") == 0x156b2bb8);
+static_assert(gnu_hash("_ZNSt8ios_base4InitC1Ev") == 0x4cd4b8c7);
+// Bytes are hashed unsigned, whatever the signedness of char
+static_assert(gnu_hash("\xff") == 5381 * 33 + 255);
+
+constexpr SymbolHandle PRINTF = "printf"_qsym;
+static_assert(PRINTF.hash == 0x156b2bb8);
+static_assert(PRINTF.name.size() == 6);
+
+void test_runtime() {
+  // Same values when the name is only known at runtime
+  const std::string name = std::string{"print"} + "f";
+  CHECK(gnu_hash(name) == 0x156b2bb8);
+  const SymbolHandle handle{name};
+  CHECK(handle.name == "printf");
+  CHECK(handle.hash == PRINTF.hash);
+  // Embedded NUL bytes are part of the name
+  CHECK(gnu_hash(std::string_view{"a\0b", 3}) != gnu_hash("a"));
+}
+} // namespace
+
+int main() {
+  test_runtime();
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include "check.hpp"
+#include "symbol_index.hpp"
+
+#include <string>
+
+using namespace QBDL;
+
+namespace {
+constexpr uint64_t BASE = 0x400000;
+
+bool lookup(const SymbolIndex &index, uint64_t rva, std::string &name,
+            uint64_t &func_rva) {
+  std::string_view view;
+  if (!index.lookup(rva, view, func_rva)) {
+    return false;
+  }
+  name = std::string{view};
+  return true;
+}
+
+void test_sort_functions() {
+  std::vector<FunctionSymbol> functions{{"c", 0x3000, 0},
+                                        {"a", 0x1000, 0x10},
+                                        {"b", 0x2000, 0},
+                                        {"a", 0x1000, 0x10},
+                                        {"b_alias", 0x2000, 0}};
+  sort_functions(functions, 0x4000);
+  CHECK(functions.size() == 4);
+  CHECK(functions[0].name == "a" && functions[0].size == 0x10);
+  // Aliases both extend up to the next distinct address
+  CHECK(functions[1].name == "b" && functions[1].size == 0x1000);
+  CHECK(functions[2].name == "b_alias" && functions[2].size == 0x1000);
+  // The last one extends up to the end of the image
+  CHECK(functions[3].name == "c" && functions[3].size == 0x1000);
+}
+
+void test_empty() {
+  SymbolIndex index{{}, BASE, 0x1000};
+  CHECK(index.size() == 0);
+  std::string name;
+  uint64_t rva = 0;
+  CHECK(!lookup(index, 0, name, rva));
+  CHECK(!lookup(index, 0x800, name, rva));
+}
+
+void test_disjoint() {
+  SymbolIndex index{{{"first", BASE + 0x1000, 0x10},
+                     {"second", BASE + 0x2000, 0x20},
+                     // Outside the image or unnamed
+                     {"before", BASE - 0x10, 0x10},
+                     {"", BASE + 0x3000, 0x10}},
+                    BASE, 0x4000};
+  CHECK(index.size() == 2);
+  std::string name;
+  uint64_t rva = 0;
+  CHECK(!lookup(index, 0xfff, name, rva));
+  CHECK(lookup(index, 0x1000, name, rva));
+  CHECK(name == "first" && rva == 0x1000);
+  CHECK(lookup(index, 0x100f, name, rva));
+  CHECK(name == "first" && rva == 0x1000);
+  // Gap between two functions
+  CHECK(!lookup(index, 0x1010, name, rva));
+  CHECK(lookup(index, 0x201f, name, rva));
+  CHECK(name == "second" && rva == 0x2000);
+  // Past the last function
+  CHECK(!lookup(index, 0x2020, name, rva));
+  CHECK(!lookup(index, 0x3008, name, rva));
+}
+
+void test_nested() {
+  SymbolIndex index{{{"outer", BASE + 0x1000, 0x100},
+                     {"inner", BASE + 0x1010, 0x10},
+                     {"innermost", BASE + 0x1014, 0x4},
+                     {"tail", BASE + 0x10f0, 0x20}},
+                    BASE, 0x2000};
+  std::string name;
+  uint64_t rva = 0;
+  CHECK(lookup(index, 0x1008, name, rva));
+  CHECK(name == "outer" && rva == 0x1000);
+  CHECK(lookup(index, 0x1010, name, rva));
+  CHECK(name == "inner" && rva == 0x1010);
+  CHECK(lookup(index, 0x1016, name, rva));
+  CHECK(name == "innermost" && rva == 0x1014);
+  // Past the end of the nested functions: back to the enclosing ones
+  CHECK(lookup(index, 0x1018, name, rva));
+  CHECK(name == "inner" && rva == 0x1010);
+  CHECK(lookup(index, 0x1020, name, rva));
+  CHECK(name == "outer" && rva == 0x1000);
+  // Overlapping ranges: the one starting last wins
+  CHECK(lookup(index, 0x10f8, name, rva));
+  CHECK(name == "tail" && rva == 0x10f0);
+  CHECK(lookup(index, 0x1108, name, rva));
+  CHECK(name == "tail" && rva == 0x10f0);
+  CHECK(!lookup(index, 0x1110, name, rva));
+}
+
+void test_aliases() {
+  // A shorter alias at the same address as a longer function
+  SymbolIndex index{{{"long", BASE + 0x1000, 0x100},
+                     {"short", BASE + 0x1000, 0x8}},
+                    BASE, 0x2000};
+  CHECK(index.size() == 2);
+  std::string name;
+  uint64_t rva = 0;
+  CHECK(lookup(index, 0x1004, name, rva));
+  CHECK(rva == 0x1000);
+  CHECK(lookup(index, 0x1080, name, rva));
+  CHECK(name == "long" && rva == 0x1000);
+}
+
+void test_zero_size() {
+  // A marker at the very end of the image keeps an empty range, and
+  // doesn't hide the function that runs past it
+  SymbolIndex index{{{"body", BASE + 0x1f00, 0x200},
+                     {"end", BASE + 0x2000, 0}},
+                    BASE, 0x2000};
+  std::string name;
+  uint64_t rva = 0;
+  CHECK(lookup(index, 0x2000, name, rva));
+  CHECK(name == "body" && rva == 0x1f00);
+  CHECK(!lookup(index, 0x2100, name, rva));
+}
+} // namespace
+
+int main() {
+  test_sort_functions();
+  test_empty();
+  test_disjoint();
+  test_nested();
+  test_aliases();
+  test_zero_size();
+  return 0;
+}
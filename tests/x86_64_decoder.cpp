@@ -0,0 +1,55 @@
+#include "check.hpp"
+#include "x86_64_decoder.hpp"
+
+#include <vector>
+
+using namespace QBDL;
+
+namespace {
+size_t length(std::vector<uint8_t> code) {
+  return x86_64::insn_length(code.data(), code.size());
+}
+
+void test_lengths() {
+  CHECK(length({0x55}) == 1);                                // push rbp
+  CHECK(length({0x48, 0x89, 0xe5}) == 3);                    // mov rbp, rsp
+  CHECK(length({0xe8, 0, 0, 0, 0}) == 5);                    // call rel32
+  CHECK(length({0xe9, 0, 0, 0, 0}) == 5);                    // jmp rel32
+  CHECK(length({0xeb, 0x10}) == 2);                          // jmp rel8
+  CHECK(length({0xff, 0x25, 0, 0, 0, 0}) == 6);              // jmp [rip+x]
+  CHECK(length({0x48, 0x8b, 0x05, 0, 0, 0, 0}) == 7);        // mov rax, [rip+x]
+  CHECK(length({0x48, 0xb8, 1, 2, 3, 4, 5, 6, 7, 8}) == 10); // movabs rax
+  CHECK(length({0x66, 0xb8, 1, 2}) == 4);                    // mov ax, imm16
+  CHECK(length({0x8b, 0x44, 0x24, 0x08}) == 4);              // mov eax, [rsp+8]
+  CHECK(length({0x0f, 0x1f, 0x44, 0, 0}) == 5);              // nop dword [...]
+  CHECK(length({0xf3, 0x0f, 0x1e, 0xfa}) == 4);              // endbr64
+  CHECK(length({0xc5, 0xf8, 0x77}) == 3);                    // vzeroupper
+  CHECK(length({0xc3}) == 1);                                // ret
+}
+
+void test_immediate_e8() {
+  // An e8 byte inside an immediate is not the start of a call
+  const std::vector<uint8_t> code{0xb8, 0xe8, 0, 0, 0, // mov eax, 0xe8
+                                  0xe8, 0, 0, 0, 0};   // call rel32
+  const size_t first = x86_64::insn_length(code.data(), code.size());
+  CHECK(first == 5);
+  CHECK(x86_64::insn_length(&code[first], code.size() - first) == 5);
+}
+
+void test_invalid() {
+  // Truncated instructions
+  CHECK(length({}) == 0);
+  CHECK(length({0xe8, 0, 0}) == 0);
+  CHECK(length({0x48}) == 0);
+  // Invalid in 64-bit mode: push es, aaa
+  CHECK(length({0x06}) == 0);
+  CHECK(length({0x37}) == 0);
+}
+} // namespace
+
+int main() {
+  test_lengths();
+  test_immediate_e8();
+  test_invalid();
+  return 0;
+}